@@ -1,4 +1,6 @@
+#include <set>
 #include "API.h"
+#include "ScanFilter.hpp"
 
 API *API::api = new API();
 
@@ -14,9 +16,12 @@ API::API() {
 }
 
 API::~API() {
-    delete rm->bm;
-    delete rm->im;
+    auto bm = rm->bm;
+    auto im = rm->im;
+    // rm first: its insert cursors hold pins on bm's pages
     delete rm;
+    delete bm;
+    delete im;
     delete cm;
 }
 
@@ -46,13 +51,19 @@ bool API::Execute(MINI_TYPE::SqlCommand sqlCommand) {
                           sqlCommand.attrList);
             break;
         case InsertCmd:
-            return Insert(sqlCommand.tableName,
-                          sqlCommand.valueArray);
+            if (sqlCommand.valueRows.size() == 1)
+                return Insert(sqlCommand.tableName,
+                              sqlCommand.valueRows.front());
+            return InsertBatch(sqlCommand.tableName,
+                               sqlCommand.valueRows, true, [] {});
             break;
         case DeleteCmd:
             return Delete(sqlCommand.tableName,
                           sqlCommand.condArray);
             break;
+        case ShowBufferStatsCmd:
+            return ShowBufferStats(sqlCommand.format == "json");
+            break;
         default:
             // DO NOTHING
             break;
@@ -236,49 +247,97 @@ bool API::Select(const std::string tableName, std::vector<MINI_TYPE::Condition>
 }
 
 bool API::Insert(std::string tableName, std::vector<MINI_TYPE::SqlValue> valueList) {
+    return InsertBatch(tableName, std::vector<std::vector<MINI_TYPE::SqlValue>>(1, valueList), true, [] {});
+}
+
+bool API::InsertBatch(std::string tableName, std::vector<std::vector<MINI_TYPE::SqlValue>> rows,
+                      bool atomic, const std::function<void()> &accepted) {
     // 1) check if the table exists
 
     if (!api->cm->TableExists(tableName)) {
-        std::cerr << "Table " << tableName << " does not exist." << std::endl;
+        for (std::size_t row = 0; row < (atomic ? 1 : rows.size()); row++)
+            std::cerr << "Table " << tableName << " does not exist." << std::endl;
         return false;
     }
 
-    // 2) check if the value types are valid
+    // 2) check every row: value types, and unique values against the
+    //    indices and the rows accepted before it. Nothing is written yet;
+    //    errors[row] is the row's message, empty if it passed.
 
     auto &tableInfo = api->cm->GetTableByName(tableName);
-    if (tableInfo.attributes.size() != valueList.size()) {
-        std::cerr << "Invalid size of value list." << std::endl;
-        return false;
-    }
+    std::vector<std::set<MINI_TYPE::SqlValue>> batchKeys(tableInfo.attributes.size());
+    std::vector<MINI_TYPE::Record> records;
+    std::vector<std::string> errors(rows.size());
+    for (std::size_t row = 0; row < rows.size(); row++) {
+        auto &valueList = rows[row];
+        if (tableInfo.attributes.size() != valueList.size()) {
+            errors[row] = "Invalid size of value list.";
+            continue;
+        }
 
-    for (int i = 0; i < tableInfo.attributes.size(); i++) {
+        bool valid = true;
+        for (std::size_t i = 0; valid && i < tableInfo.attributes.size(); i++) {
+
+//            if (tableInfo.attributes[i].type != valueList[i].type) {
+//                std::cerr << "Type mismatch." << std::endl;
+//                return false;
+//            }
+
+            valueList[i].type = tableInfo.attributes[i].type;
+
+            if (valueList[i].type.type == MINI_TYPE::TypeId::MiniChar &&
+                !MINI_TYPE::IsValidString(valueList[i].type.char_size)) {
+                errors[row] = "Invalid string.";
+                valid = false;
+            } else if (tableInfo.attributes[i].unique &&
+                       (batchKeys[i].count(valueList[i]) ||
+                        api->rm->im->Find(MINI_TYPE::IndexName(tableInfo.name, tableInfo.attributes[i].name),
+                                          valueList[i]) != IndexManager::end)) {
+                errors[row] = "Attribute " + tableInfo.attributes[i].name + " should be unique.";
+                valid = false;
+            }
+        }
+        if (!valid)
+            continue;
 
-//        if (tableInfo.attributes[i].type != valueList[i].type) {
-//            std::cerr << "Type mismatch." << std::endl;
-//            return false;
-//        }
+        for (std::size_t i = 0; i < tableInfo.attributes.size(); i++)
+            if (tableInfo.attributes[i].unique)
+                batchKeys[i].insert(valueList[i]);
+        records.emplace_back(valueList);
+    }
 
-        valueList[i].type = tableInfo.attributes[i].type;
+    // 3) a statement with a bad row inserts none of its rows
 
-        if (valueList[i].type.type == MINI_TYPE::TypeId::MiniChar &&
-            !MINI_TYPE::IsValidString(valueList[i].type.char_size)) {
-            std::cerr << "Invalid string." << std::endl;
-            return false;
-        }
+    if (atomic && records.size() != rows.size()) {
+        for (auto &error : errors)
+            if (!error.empty())
+                std::cerr << error << std::endl;
+        std::cerr << "No rows inserted." << std::endl;
+        return false;
+    }
 
-        if (tableInfo.attributes[i].unique)
-            if (api->rm->im->Find(MINI_TYPE::IndexName(tableInfo.name, tableInfo.attributes[i].name), valueList[i]) !=
-                IndexManager::end) {
-                std::cerr << "Attribute " << tableInfo.attributes[i].name << " should be unique." << std::endl;
-                return false;
-            }
+    // 4) start inserting, then report each row
 
+    api->rm->InsertRecords(tableInfo, records);
+
+    for (auto &error : errors) {
+        if (error.empty())
+            accepted();
+        else
+            std::cerr << error << std::endl;
     }
 
-    // 3) start inserting
+    return records.size() == rows.size();
+}
+
+bool API::ShowBufferStats(bool json) {
+    auto stats = api->rm->bm->Stats();
+    stats.scan_kernels = ScanFilter::KernelName();
 
-    MINI_TYPE::Record record(valueList);
-    api->rm->InsertRecord(tableInfo, record);
+    if (json)
+        stats.PrintJson(std::cout);
+    else
+        stats.PrintText(std::cout);
 
     return true;
 }
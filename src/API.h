@@ -6,6 +6,7 @@
 #include "RecordManager.hpp"
 #include "CatalogManager.h"
 
+#include <functional>
 #include <string>
 
 class API {
@@ -28,6 +29,17 @@ public:
 
     static bool Insert(std::string tableName, std::vector<MINI_TYPE::SqlValue> valueList);
 
+    // Insert rows of one table together. Every row is checked like a single
+    // insert before anything is written. An atomic batch (one multi-row
+    // statement) inserts nothing if any row fails. Otherwise the rows that
+    // pass are inserted and, once they are written, each row's message
+    // comes out in order, accepted() standing for a good row's, as if the
+    // rows had been inserted one at a time. Returns whether every row passed.
+    static bool InsertBatch(std::string tableName, std::vector<std::vector<MINI_TYPE::SqlValue>> rows,
+                            bool atomic, const std::function<void()> &accepted);
+
+    static bool ShowBufferStats(bool json);
+
     static bool Exit();
 
 private:
@@ -1,48 +1,64 @@
 #include <iostream>
-#include <fstream>
 #include <cstring>
 #include <cstdlib>
-#include <sys/stat.h>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <thread>
+#include <sys/mman.h>
 // #include "DataStructure.h"
 #include "MiniType.h"
 #include "BufferManager.h"
 
 
-Block::Block() { Reset(); }
+Block::Block() : dirty(false), content(nullptr), files(nullptr), stats(nullptr), file_id(-1), block_id(-1), pins(0), loading(false),
+                 referenced(false), parked(false), queued(false) {}
 
 
 
-Block & Block::Connect(const std::string & filename, int block_id, bool get_content)
+// Attach the frame to a page. A page already in the file is read and stays
+// clean until someone writes to it; a page appended past the end starts
+// zeroed and dirty, so that the file really grows when it is written back.
+Block & Block::Load(FileManager & files, int file_id, int block_id, bool append)
 {
-    Reset();
-    dirty = true;
-	this->filename = filename;
-	this->block_id = block_id;
-    if (get_content)
-    {
-        std::ifstream fin(filename.c_str(), std::ios_base::binary);
-        if (not fin.is_open())
-        {
-            std::cerr << "Cannot open file " + filename + ".\n";
-            std::exit(0);
-        }
-        fin.seekg(block_id * MINI_TYPE::BlockSize);
-        char temp[MINI_TYPE::BlockSize];
-        fin.read(temp, MINI_TYPE::BlockSize);
-        fin.close();
-        Write(temp, 0, MINI_TYPE::BlockSize);
-    }
-	return *this;
+    this->files = &files;
+    this->file_id = file_id;
+    this->block_id = block_id;
+    if (append)
+        std::memset(content, 0, MINI_TYPE::BlockSize);
+    else
+        files.ReadBlock(file_id, block_id, content);
+    dirty = append;
+    return *this;
 }
 
+// Detach the frame from its page; the payload is overwritten by the next Load.
 Block & Block::Reset()
 {
-	dirty = pinned = false;
-	memset(content, 0, MINI_TYPE::BlockSize);
-	MRUtime = 0;
+	dirty = false;
+    file_id = block_id = -1;
     return *this;
 }
-Block & Block::SetPinned(bool pinned)  { this->pinned =  pinned; return *this;}
+
+bool Block::TryPin(int & before)
+{
+    before = pins.load();
+    while (before != Claimed)
+    {
+        if (pins.compare_exchange_weak(before, before + 1))
+            return true;
+    }
+    return false;
+}
+
+bool Block::TryClaim()
+{
+    int unpinned = 0;
+    return pins.compare_exchange_strong(unpinned, Claimed);
+}
 
 Block & Block::Write(void * source, int offset, std::size_t size)
 {
@@ -62,118 +78,1050 @@ Block & Block::Flush()
 	if (dirty)
 	{
 		dirty = false;
-        std::fstream fout(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
-        if (not fout.is_open())
-        {
-            std::cerr << "Cannot open file " + filename + "!\n";
-            exit(0);
-        }
-		fout.seekp(block_id * MINI_TYPE::BlockSize);
-		fout.write(content, MINI_TYPE::BlockSize);
-		fout.close();
+        files->WriteBlock(file_id, block_id, content);
 	}
 	
 	return *this;
 }
 
-Block & Block::SetMRUtime(int t) 
+// "4096", "64K", "512M", "2G"
+static bool ParseSize(const char * text, std::size_t & bytes)
 {
-	MRUtime = t;
-    return *this;
+    char * end;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if (end == text)
+        return false;
+    switch (*end)
+    {
+        case 'G': case 'g': value <<= 10;
+            // fall through
+        case 'M': case 'm': value <<= 10;
+            // fall through
+        case 'K': case 'k': value <<= 10; end++;
+        default: break;
+    }
+    if (*end != '\0')
+        return false;
+    bytes = std::size_t(value);
+    return true;
 }
-int BufferManager::PastTheEndBlockID(const std::string & filename)
+
+// A plain decimal count from low to high, for the options that are not sizes.
+static bool ParseCount(const char * text, int low, int high, int & count)
+{
+    char * end;
+    errno = 0;
+    long value = std::strtol(text, &end, 10);
+    if (end == text or *end != '\0' or errno == ERANGE or value < low or value > high)
+        return false;
+    count = int(value);
+    return true;
+}
+
+// 1 TiB of 4 KB blocks
+static const int MaxPoolBlocks = 1 << 28;
+
+BufferOptions BufferOptions::FromEnvironment()
 {
-    struct stat st;
-    if (stat(filename.c_str(), &st) == 0) {
-        return int(st.st_size / MINI_TYPE::BlockSize);
+    BufferOptions options;
+    if (const char * policy = std::getenv("MINISQL_BUFFER_POLICY"))
+    {
+        if (not ReplacementPolicy::ParseKind(policy, options.policy))
+            std::cerr << "Unknown buffer policy " << policy << ", using lru.\n";
     }
-    else
+    std::size_t value;
+    if (const char * size = std::getenv("MINISQL_BUFFER_SIZE"))
     {
-        std::cerr << "Failed to get file past-the-end.\n";
-        exit(0);
+        if (ParseSize(size, value) and value >= std::size_t(MINI_TYPE::BlockSize)
+            and value / MINI_TYPE::BlockSize <= std::size_t(MaxPoolBlocks))
+            options.pool_blocks = int(value / MINI_TYPE::BlockSize);
+        else
+            std::cerr << "Invalid buffer size " << size << ", ignored.\n";
+    }
+    if (const char * blocks = std::getenv("MINISQL_BUFFER_BLOCKS"))
+    {
+        if (not ParseCount(blocks, 1, MaxPoolBlocks, options.pool_blocks))
+            std::cerr << "Invalid buffer block count " << blocks << ", ignored.\n";
+    }
+    if (const char * huge = std::getenv("MINISQL_BUFFER_HUGEPAGES"))
+        options.huge_pages = std::strcmp(huge, "0") != 0;
+    if (const char * direct = std::getenv("MINISQL_DIRECT_IO"))
+        options.direct_io = std::strcmp(direct, "0") != 0;
+    if (const char * ratio = std::getenv("MINISQL_DIRTY_RATIO"))
+    {
+        char * end;
+        double value = std::strtod(ratio, &end);
+        if (end != ratio and *end == '\0' and value >= 0)
+            options.dirty_ratio = value;
+        else
+            std::cerr << "Invalid dirty ratio " << ratio << ", ignored.\n";
     }
+    if (const char * interval = std::getenv("MINISQL_WRITER_INTERVAL"))
+    {
+        // at most an hour
+        if (not ParseCount(interval, 1, 3600 * 1000, options.writer_interval_ms))
+            std::cerr << "Invalid writer interval " << interval << ", ignored.\n";
+    }
+    if (const char * blocks = std::getenv("MINISQL_READAHEAD"))
+    {
+        if (not ParseCount(blocks, 0, MaxPoolBlocks, options.readahead_blocks))
+            std::cerr << "Invalid read-ahead " << blocks << ", ignored.\n";
+    }
+    if (const char * threads = std::getenv("MINISQL_IO_THREADS"))
+    {
+        if (not ParseCount(threads, 1, 256, options.io_threads))
+            std::cerr << "Invalid I/O thread count " << threads << ", ignored.\n";
+    }
+    if (const char * ring = std::getenv("MINISQL_RING_BLOCKS"))
+    {
+        if (not ParseCount(ring, 0, MaxPoolBlocks, options.ring_blocks))
+            std::cerr << "Invalid ring size " << ring << ", ignored.\n";
+    }
+    if (const char * threshold = std::getenv("MINISQL_RING_THRESHOLD"))
+    {
+        if (not ParseCount(threshold, 0, INT_MAX, options.ring_threshold))
+            std::cerr << "Invalid ring threshold " << threshold << ", ignored.\n";
+    }
+    if (const char * file = std::getenv("MINISQL_WARMUP_FILE"))
+        options.warmup_file = file;
+    return options;
+}
+PageTable::PageTable(int frames)
+{
+    std::size_t capacity = 16;
+    while (capacity < std::size_t(frames) * 2)
+        capacity <<= 1;
+    slots.assign(capacity, Slot{0, -1});
+    mask = capacity - 1;
+}
+
+std::uint64_t PageTable::Key(int file_id, int block_id)
+{
+    return (std::uint64_t(std::uint32_t(file_id)) << 32) | std::uint32_t(block_id);
 }
 
-Block * BufferManager::GetBlock(const std::string & filename, int block_id)
+std::uint64_t PageTable::Hash(std::uint64_t key)
 {
-    std::ifstream fin(filename);
-    if (not fin.is_open())
+    // splitmix64 finalizer: consecutive block ids of one file spread well
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+int PageTable::Find(int file_id, int block_id) const
+{
+    std::uint64_t key = Key(file_id, block_id);
+    for (std::size_t i = Home(key); slots[i].frame >= 0; i = (i + 1) & mask)
     {
-        std::cerr << "File " + filename + " does not exists!\n";
-        exit(0);
+        if (slots[i].key == key)
+            return slots[i].frame;
+    }
+    return -1;
+}
+
+void PageTable::Insert(int file_id, int block_id, int frame)
+{
+    if ((count + 1) * 2 > slots.size())
+        Grow();
+    std::uint64_t key = Key(file_id, block_id);
+    std::size_t i = Home(key);
+    while (slots[i].frame >= 0 and slots[i].key != key)
+        i = (i + 1) & mask;
+    if (slots[i].frame < 0)
+        count++;
+    slots[i].key = key;
+    slots[i].frame = frame;
+}
+
+void PageTable::Grow()
+{
+    std::vector<Slot> old(slots.size() * 2, Slot{0, -1});
+    old.swap(slots);
+    mask = slots.size() - 1;
+    for (auto & slot : old)
+    {
+        if (slot.frame < 0)
+            continue;
+        std::size_t i = Home(slot.key);
+        while (slots[i].frame >= 0)
+            i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
+
+void PageTable::Erase(int file_id, int block_id)
+{
+    std::uint64_t key = Key(file_id, block_id);
+    std::size_t i = Home(key);
+    while (slots[i].frame >= 0 and slots[i].key != key)
+        i = (i + 1) & mask;
+    if (slots[i].frame < 0)
+        return;
+    count--;
+    // shift the rest of the cluster back so that lookups never hit a hole
+    std::size_t hole = i;
+    for (std::size_t j = (hole + 1) & mask; slots[j].frame >= 0; j = (j + 1) & mask)
+    {
+        std::size_t home = Home(slots[j].key);
+        if (((j - home) & mask) >= ((j - hole) & mask))
+        {
+            slots[hole] = slots[j];
+            hole = j;
+        }
+    }
+    slots[hole].frame = -1;
+}
+
+BufferManager::BufferManager(const BufferOptions & options)
+    : files(options.direct_io),
+      blocks(options.pool_blocks),
+      pinned_frames(0),
+      pinned_high_water(0),
+      batch_frames(std::max(1, std::min(64, options.pool_blocks / 4))),
+      // a ring must leave most of the pool to everyone else
+      ring_blocks(std::min(options.ring_blocks, std::max(1, options.pool_blocks / 8))),
+      ring_threshold(options.ring_threshold >= 0 ? options.ring_threshold : options.pool_blocks / 4),
+      policy(ReplacementPolicy::Create(options.policy, options.pool_blocks)),
+      dirty_frames(options.pool_blocks),
+      dirty_target(int(options.dirty_ratio * options.pool_blocks)),
+      writer_interval(options.writer_interval_ms),
+      readahead(options.readahead_blocks),
+      stop_prefetch(false),
+      warmup_file(options.warmup_file)
+{
+    for (int i = 0; i < Partitions; i++)
+        partitions.emplace_back(new Partition(options.pool_blocks / Partitions));
+    // One anonymous mapping for all payloads: page aligned, zero filled,
+    // and only backed by memory as frames are first used.
+    arena_bytes = std::size_t(options.pool_blocks) * MINI_TYPE::BlockSize;
+    arena = static_cast<char *>(MAP_FAILED);
+#ifdef MAP_HUGETLB
+    if (options.huge_pages)
+    {
+        const std::size_t huge_page = std::size_t(2) << 20;
+        std::size_t huge_bytes = (arena_bytes + huge_page - 1) / huge_page * huge_page;
+        arena = static_cast<char *>(mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+        if (arena != MAP_FAILED)
+            arena_bytes = huge_bytes;
+    }
+#endif
+    if (arena == MAP_FAILED)
+    {
+        arena = static_cast<char *>(mmap(nullptr, arena_bytes, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (arena == MAP_FAILED)
+        {
+            std::cerr << "Cannot allocate the buffer pool.\n";
+            std::exit(0);
+        }
+#ifdef MADV_HUGEPAGE
+        // no reserved huge pages: let transparent huge pages back it instead
+        if (options.huge_pages)
+            madvise(arena, arena_bytes, MADV_HUGEPAGE);
+#endif
+    }
+    for (int frame = options.pool_blocks - 1; frame >= 0; frame--)
+    {
+        blocks[frame].content = arena + std::size_t(frame) * MINI_TYPE::BlockSize;
+        free_frames.push_back(frame);
+    }
+    if (options.dirty_ratio < 1)
+        writer = std::thread(&BufferManager::BackgroundWriter, this);
+    std::vector<std::pair<std::string, int>> warm_pages;
+    if (not warmup_file.empty())
+    {
+        std::ifstream in(warmup_file);
+        std::string name;
+        int block_id;
+        while (int(warm_pages.size()) < options.pool_blocks and in >> name >> block_id)
+            warm_pages.emplace_back(name, block_id);
+    }
+    if (readahead > 0 or not warm_pages.empty())
+        io_pool.reset(new ThreadPool(options.io_threads));
+    if (not warm_pages.empty())
+        io_pool->Submit([this, warm_pages] { WarmUp(warm_pages); });
+}
+
+BufferManager::~BufferManager()
+{
+    if (io_pool)
+    {
+        stop_prefetch = true;
+        io_pool.reset();
+    }
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(pool_latch);
+            stop_writer = true;
+        }
+        writer_wakeup.notify_one();
+        writer.join();
     }
-    if (block_id > PastTheEndBlockID(filename))
+    SaveWarmUp();
+    FlushAllBlocks();
+    munmap(arena, arena_bytes);
+}
+
+bool BufferManager::Pin(int frame)
+{
+    int before;
+    if (not blocks[frame].TryPin(before))
+        return false;
+    if (before == 0)
+        NotePinned();
+    return true;
+}
+
+void BufferManager::NotePinned()
+{
+    int pinned = pinned_frames.fetch_add(1, std::memory_order_relaxed) + 1;
+    int high = pinned_high_water.load(std::memory_order_relaxed);
+    while (pinned > high and not pinned_high_water.compare_exchange_weak(high, pinned, std::memory_order_relaxed))
+        ;
+}
+
+BufferStats BufferManager::Stats()
+{
+    BufferStats stats;
+    stats.frames = int(blocks.size());
+    stats.pinned = pinned_frames.load(std::memory_order_relaxed);
+    stats.pinned_high_water = pinned_high_water.load(std::memory_order_relaxed);
+    for (auto & block : blocks)
+        stats.dirty += block.dirty ? 1 : 0;
+    files.ForEachFile([&](const std::string & name, const FileStats & counters)
+    {
+        BufferStats::File file;
+        file.name = name;
+        file.hits = counters.hits.load(std::memory_order_relaxed);
+        file.misses = counters.misses.load(std::memory_order_relaxed);
+        file.prefetches = counters.prefetches.load(std::memory_order_relaxed);
+        file.evictions = counters.evictions.load(std::memory_order_relaxed);
+        file.read_bytes = counters.reads.load(std::memory_order_relaxed) * MINI_TYPE::BlockSize;
+        file.write_bytes = counters.writes.load(std::memory_order_relaxed) * MINI_TYPE::BlockSize;
+        file.write_calls = counters.write_calls.load(std::memory_order_relaxed);
+        if (file.hits + file.misses + file.prefetches + file.evictions + file.write_bytes == 0)
+            return;
+        stats.hits += file.hits;
+        stats.misses += file.misses;
+        stats.prefetches += file.prefetches;
+        stats.evictions += file.evictions;
+        stats.write_backs += file.write_bytes / MINI_TYPE::BlockSize;
+        stats.read_bytes += file.read_bytes;
+        stats.write_bytes += file.write_bytes;
+        stats.write_calls += file.write_calls;
+        stats.files.push_back(file);
+    });
+    return stats;
+}
+
+void BufferStats::PrintText(std::ostream & out) const
+{
+    std::uint64_t requests = hits + misses;
+    // formatted apart so that the caller's stream keeps its flags
+    std::ostringstream ratio;
+    ratio << std::fixed << std::setprecision(1) << (requests ? 100.0 * hits / requests : 0.0) << "%";
+    out << "frames: " << frames << ", pinned: " << pinned << " (high water " << pinned_high_water
+        << "), dirty: " << dirty << "\n";
+    out << "hits: " << hits << ", misses: " << misses << ", hit ratio: " << ratio.str()
+        << ", prefetched: " << prefetches << "\n";
+    out << "evictions: " << evictions << ", write-backs: " << write_backs << " in " << write_calls << " writes\n";
+    out << "read bytes: " << read_bytes << ", written bytes: " << write_bytes << "\n";
+    if (not scan_kernels.empty())
+        out << "scan kernels: " << scan_kernels << "\n";
+    out << "file|hits|misses|prefetched|evictions|read bytes|written bytes|\n";
+    for (auto & file : files)
+        out << file.name << "|" << file.hits << "|" << file.misses << "|" << file.prefetches << "|"
+            << file.evictions << "|" << file.read_bytes << "|" << file.write_bytes << "|\n";
+}
+
+// One JSON object on one line, so that it can be picked out of the output.
+void BufferStats::PrintJson(std::ostream & out) const
+{
+    out << "{\"frames\":" << frames << ",\"pinned\":" << pinned << ",\"pinned_high_water\":" << pinned_high_water
+        << ",\"dirty\":" << dirty << ",\"hits\":" << hits << ",\"misses\":" << misses
+        << ",\"prefetches\":" << prefetches << ",\"evictions\":" << evictions
+        << ",\"write_backs\":" << write_backs << ",\"write_calls\":" << write_calls
+        << ",\"read_bytes\":" << read_bytes << ",\"write_bytes\":" << write_bytes;
+    if (not scan_kernels.empty())
+        out << ",\"scan_kernels\":\"" << scan_kernels << "\"";
+    out << ",\"files\":[";
+    for (std::size_t i = 0; i < files.size(); i++)
+    {
+        const File & file = files[i];
+        out << (i ? "," : "") << "{\"name\":\"";
+        for (char c : file.name)
+        {
+            if (c == '"' or c == '\\')
+                out << '\\';
+            out << c;
+        }
+        out << "\",\"hits\":" << file.hits << ",\"misses\":" << file.misses << ",\"prefetches\":" << file.prefetches
+            << ",\"evictions\":" << file.evictions << ",\"read_bytes\":" << file.read_bytes
+            << ",\"write_bytes\":" << file.write_bytes << ",\"write_calls\":" << file.write_calls << "}";
+    }
+    out << "]}\n";
+}
+
+BufferManager::Partition & BufferManager::PartitionOf(int file_id, int block_id)
+{
+    // the top bits, since PageTable::Home uses the bottom ones
+    return *partitions[PageTable::Hash(PageTable::Key(file_id, block_id)) >> 60];
+}
+
+int BufferManager::FileID(const std::string & filename)
+{
+    return files.FileID(filename);
+}
+
+int BufferManager::PastTheEndBlockID(int file_id)
+{
+    return files.BlockCount(file_id);
+}
+
+BufferManager::PageGuard & BufferManager::PageGuard::operator=(PageGuard && other)
+{
+    if (this != &other)
+    {
+        Release();
+        std::swap(bm, other.bm);
+        std::swap(frame, other.frame);
+        std::swap(data, other.data);
+        std::swap(latch, other.latch);
+    }
+    return *this;
+}
+
+void BufferManager::PageGuard::Release()
+{
+    if (frame >= 0)
+        bm->Unpin(frame);
+    bm = nullptr;
+    frame = -1;
+    data = nullptr;
+    latch = nullptr;
+}
+
+BufferManager::PageGuard BufferManager::GetBlock(int file_id, int block_id, BufferRing * ring, bool append)
+{
+    int past_the_end = files.BlockCount(file_id);
+    if (block_id > past_the_end or (block_id == past_the_end and not append))
     {
         std::cerr << "Block id out of bound.\n";
         exit(0);
     }
-    auto block_iter = block_map.find(std::make_pair(filename, block_id));
-	if (block_iter != block_map.end())
-	{
-		block_iter->second.SetPinned(true);
-		block_iter->second.SetMRUtime(access_counter++);
-		return &block_iter->second;
-	}
-	else
-	{
-		Block & block = GetLRU();
-        if (PastTheEndBlockID(filename) == block_id)
-            block.Reset().Flush().Connect(filename, block_id, false).SetPinned(true).SetMRUtime(access_counter++).Flush();
-        else
-            block.Reset().Flush().Connect(filename, block_id, true).SetPinned(true).SetMRUtime(access_counter++).Flush();
-        block_map.erase(std::make_pair(block.filename, block.block_id));
-        block_map.insert(MapType::value_type(std::make_pair(filename, block_id), block));
-		return &block;
-	}
+    ReadAhead(file_id, block_id, past_the_end, ring == nullptr);
+    while (true)
+    {
+        int frame = PinResident(file_id, block_id);
+        if (frame >= 0)
+            return PageGuard(this, frame);
+        frame = ring ? RecycleRingFrame(*ring) : -1;
+        if (frame < 0)
+            frame = GetVictim();
+        if (frame < 0)
+        {
+            std::cerr << "No unpinned block to evict!\n";
+            exit(0);
+        }
+        EvictFrame(frame);
+        if (not InstallPage(frame, file_id, block_id))
+        {
+            ReleaseFrame(frame);
+            continue;
+        }
+        FileStats::Bump(blocks[frame].stats->misses);
+        if (ring)
+        {
+            ring->slots[ring->next].frame = frame;
+            ring->slots[ring->next].key = PageTable::Key(file_id, block_id);
+            ring->next = (ring->next + 1) % ring->slots.size();
+        }
+        // the page may have been appended and written back by another
+        // thread since past_the_end was read
+        bool grow = append and block_id >= files.BlockCount(file_id);
+        blocks[frame].Load(files, file_id, block_id, grow);
+        if (grow)
+            files.Extend(file_id, block_id + 1);
+        FinishLoad(frame);
+        return PageGuard(this, frame);
+    }
 }
-void BufferManager::FreeBlock(const std::string & filename, int block_id)
+
+BufferManager::PageGuard BufferManager::GetHintedBlock(int file_id, int block_id, int & hint, bool append)
 {
-	auto block_iter = block_map.find(std::make_pair(filename, block_id));
-	if (block_iter == block_map.end())
-	{
-		std::cerr << "Block not allocated!\n";
-		std::exit(0);
-	}
-	else
-		block_iter->second.SetPinned(false);
+    if (hint >= 0 and hint < int(blocks.size()) and Pin(hint))
+    {
+        // the page can only leave the frame while it is claimed, which the
+        // pin rules out
+        Block & block = blocks[hint];
+        if (block.file_id == file_id and block.block_id == block_id and not block.loading)
+        {
+            NoteHit(block);
+            return PageGuard(this, hint);
+        }
+        Unpin(hint);
+    }
+    PageGuard page = GetBlock(file_id, block_id, nullptr, append);
+    hint = page.frame;
+    return page;
+}
+
+BufferManager::PageGuard BufferManager::GetMappedBlock(int file_id, int block_id, bool append)
+{
+    char * data = files.MapBlock(file_id, block_id, append);
+    std::uint64_t stripe = PageTable::Hash(PageTable::Key(file_id, block_id)) % MappedLatches;
+    return PageGuard(data, &mapped_latches[stripe]);
+}
+
+int BufferManager::PinResident(int file_id, int block_id)
+{
+    Partition & partition = PartitionOf(file_id, block_id);
+    int frame;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> guard(partition.latch);
+            frame = partition.table.Find(file_id, block_id);
+            if (frame < 0)
+                return -1;
+            if (Pin(frame))
+                break;
+        }
+        // claimed for eviction: wait for the evicting thread to let go of
+        // the frame, after which the page is gone or somewhere else
+        blocks[frame].latch.lock_shared();
+        blocks[frame].latch.unlock_shared();
+        std::this_thread::yield();
+    }
+    Block & block = blocks[frame];
+    if (block.loading)
+    {
+        block.latch.lock_shared();
+        block.latch.unlock_shared();
+    }
+    NoteHit(block);
+    return frame;
 }
+
+void BufferManager::NoteHit(Block & block)
+{
+    FileStats::Bump(block.stats->hits);
+    if (not block.referenced.load(std::memory_order_relaxed))
+        block.referenced.store(true, std::memory_order_relaxed);
+}
+
+void BufferManager::Unpin(int frame)
+{
+    Block & block = blocks[frame];
+    if (block.pins.fetch_sub(1) != 1)
+        return;
+    pinned_frames.fetch_sub(1, std::memory_order_relaxed);
+    // the frame is still evictable to the policy, unless GetVictim set it
+    // aside meanwhile; it reads the pin count after marking it parked, so
+    // one of the two sees the other
+    if (not block.parked and not (block.dirty and not block.queued) and claim_waiters == 0)
+        return;
+    std::lock_guard<std::mutex> guard(pool_latch);
+    if (claim_waiters > 0)
+        frame_released.notify_all();
+    // pinned or claimed again since the count dropped: the new owner's
+    // unpin or release does this instead
+    if (block.pins != 0)
+        return;
+    if (block.parked)
+    {
+        block.parked = false;
+        policy->SetEvictable(frame, true);
+    }
+    if (block.dirty and not block.queued)
+    {
+        block.queued = true;
+        dirty_frames.PushBack(frame);
+        if (dirty_frames.Size() > dirty_target)
+            writer_wakeup.notify_one();
+    }
+}
+
 void BufferManager::CreateFile(const std::string & filename)
 {
-	std::ofstream(filename.c_str());
+    std::lock_guard<std::shared_timed_mutex> guard(file_latch);
+	files.Create(filename);
 }
 
 void BufferManager::RemoveFile(const std::string & filename)
 {
-	for (auto iter = block_map.begin(); iter != block_map.end(); iter++)
-	{
-        if (iter->first.first == filename)
-        	block_map.erase(iter);
+    int file_id;
+    {
+        // the pins on the file's pages are waited out under the shared
+        // latch, so that other files are not held up meanwhile
+        std::shared_lock<std::shared_timed_mutex> guard(file_latch);
+        file_id = files.FileID(filename);
+        DropPages(file_id);
+    }
+    std::lock_guard<std::shared_timed_mutex> guard(file_latch);
+    // pages a prefetch queued earlier has loaded since
+    DropPages(file_id);
+	files.Remove(filename);
+    // a new file of the same name must not pick up the old one's run
+    int owner = file_id;
+    sequences[file_id % Sequences].file_id.compare_exchange_strong(owner, -1);
+}
+
+void BufferManager::DropPages(int file_id)
+{
+    std::vector<std::pair<int, int>> pages;
+    for (auto & partition : partitions)
+    {
+        std::lock_guard<std::mutex> guard(partition->latch);
+        partition->table.ForEach([&](std::uint64_t key, int frame)
+        {
+            // pages of other files may stay pinned for long
+            if (int(key >> 32) == file_id)
+                pages.emplace_back(int(key & 0xffffffff), frame);
+        });
+    }
+    for (auto & page : pages)
+    {
+        int frame = page.second;
+        Block & block = blocks[frame];
+        if (not ClaimPage(file_id, page.first, frame))
+            continue;
+        if (block.file_id != file_id)
+        {
+            ReleaseClaim(frame);
+            continue;
+        }
+        {
+            Partition & partition = PartitionOf(block.file_id, block.block_id);
+            std::lock_guard<std::mutex> guard(partition.latch);
+            partition.table.Erase(block.file_id, block.block_id);
+        }
+        block.Reset();
+        std::lock_guard<std::mutex> guard(pool_latch);
+        policy->Forget(frame);
+        block.parked = false;
+        dirty_frames.Remove(frame);
+        block.queued = false;
+        free_frames.push_back(frame);
+        block.pins = 0;
+        if (claim_waiters > 0)
+            frame_released.notify_all();
+    }
+}
+
+// The writer or a prefetch may hold a pin for a moment, and a victim search
+// a claim; the file's users are gone. Once the page has left the frame, the
+// frame may be pinned for long by the page's successor, so it is let be.
+bool BufferManager::ClaimPage(int file_id, int block_id, int frame)
+{
+    Block & block = blocks[frame];
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool_latch);
+            claim_waiters++;
+            bool claimed = frame_released.wait_for(lock, std::chrono::milliseconds(1), [&] { return block.TryClaim(); });
+            claim_waiters--;
+            if (claimed)
+                return true;
+        }
+        Partition & partition = PartitionOf(file_id, block_id);
+        std::lock_guard<std::mutex> guard(partition.latch);
+        if (partition.table.Find(file_id, block_id) != frame)
+            return false;
     }
-	remove(filename.c_str());
 }
 
 void BufferManager::FlushAllBlocks()
 {
-    for (auto & block : block_map)
-        block.second.Flush();
+    std::vector<std::pair<std::uint64_t, int>> pages;
+    for (auto & partition : partitions)
+    {
+        std::lock_guard<std::mutex> guard(partition->latch);
+        partition->table.ForEach([&](std::uint64_t key, int frame)
+        {
+            if (blocks[frame].dirty)
+                pages.emplace_back(key, frame);
+        });
+    }
+    // sorting up front keeps runs whole across batches
+    std::sort(pages.begin(), pages.end());
+    std::vector<int> batch;
+    for (std::size_t i = 0; i < pages.size(); )
+    {
+        batch.clear();
+        for (; i < pages.size() and int(batch.size()) < batch_frames; i++)
+        {
+            Block & block = blocks[pages[i].second];
+            if (not Pin(pages[i].second))
+                continue;
+            // evicted and reused since the pages were listed
+            if (PageTable::Key(block.file_id, block.block_id) != pages[i].first)
+                Unpin(pages[i].second);
+            else
+                batch.push_back(pages[i].second);
+        }
+        WriteBack(batch);
+        for (int frame : batch)
+            Unpin(frame);
+    }
 }
-Block & BufferManager::GetLRU()
+
+void BufferManager::WriteBack(std::vector<int> & frames)
 {
-	int min = access_counter;
-	Block * pb = nullptr;
-	for (auto & block : blocks)
-	{
-		if (not block.pinned and block.MRUtime < min)
-		{
-			min = block.MRUtime;
-			pb = &block;
-		}
-	}
-	if (not pb)
-	{
-		std::cerr << "No LRU block found!\n";
-		exit(0);
-	}
-	else
-		return *pb;
+    auto end = std::remove_if(frames.begin(), frames.end(), [this](int frame)
+    {
+        return blocks[frame].file_id < 0 or not blocks[frame].dirty;
+    });
+    std::sort(frames.begin(), end, [this](int a, int b)
+    {
+        return PageTable::Key(blocks[a].file_id, blocks[a].block_id)
+             < PageTable::Key(blocks[b].file_id, blocks[b].block_id);
+    });
+    std::vector<char *> pages;
+    std::vector<int> latched;
+    for (auto run = frames.begin(); run != end; )
+    {
+        const Block & first = blocks[*run];
+        auto next = run + 1;
+        while (next != end and blocks[*next].file_id == first.file_id
+               and blocks[*next].block_id == first.block_id + int(next - run))
+            next++;
+        pages.clear();
+        for (auto frame = run; frame != next; frame++)
+            pages.push_back(blocks[*frame].content);
+        // latches are taken in frame order, the one order all holders of
+        // several latches agree on
+        latched.assign(run, next);
+        std::sort(latched.begin(), latched.end());
+        for (int frame : latched)
+        {
+            blocks[frame].latch.lock_shared();
+            blocks[frame].dirty = false;
+        }
+        files.WriteBlocks(first.file_id, first.block_id, pages.data(), int(pages.size()));
+        for (int frame : latched)
+            blocks[frame].latch.unlock_shared();
+        run = next;
+    }
+}
+
+int BufferManager::GetVictim()
+{
+    int frame = -1;
+    {
+        std::lock_guard<std::mutex> guard(pool_latch);
+        if (not free_frames.empty())
+        {
+            frame = free_frames.back();
+            free_frames.pop_back();
+            // a ring may be checking the frame for a moment
+            while (not blocks[frame].TryClaim())
+                std::this_thread::yield();
+        }
+        else
+        {
+            while ((frame = policy->Victim()) >= 0)
+            {
+                Block & block = blocks[frame];
+                // hit since the policy last looked: the Touch the hit
+                // did not make, and another try
+                if (block.referenced.exchange(false))
+                {
+                    policy->Restore(frame);
+                    policy->Touch(frame);
+                    policy->SetEvictable(frame, true);
+                    continue;
+                }
+                if (block.TryClaim())
+                    break;
+                // pinned, or claimed by a ring or RemoveFile: it stays where
+                // it was, and the last unpin or the claim's release makes it
+                // evictable again
+                policy->Restore(frame);
+                policy->SetEvictable(frame, false);
+                block.parked = true;
+                if (block.pins == 0)
+                {
+                    block.parked = false;
+                    policy->SetEvictable(frame, true);
+                }
+            }
+        }
+        if (frame >= 0)
+        {
+            dirty_frames.Remove(frame);
+            blocks[frame].queued = false;
+        }
+    }
+    if (frame >= 0)
+        blocks[frame].latch.lock();
+    return frame;
+}
+
+// The frame in the ring's next slot, if it still holds the page the ring put
+// there and nobody else is using it; it is taken out of the policy.
+int BufferManager::RecycleRingFrame(BufferRing & ring)
+{
+    const BufferRing::Slot & slot = ring.slots[ring.next];
+    if (slot.frame < 0)
+        return -1;
+    Block & block = blocks[slot.frame];
+    if (not block.TryClaim())
+        return -1;
+    if (block.file_id < 0 or PageTable::Key(block.file_id, block.block_id) != slot.key)
+    {
+        ReleaseClaim(slot.frame);
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool_latch);
+        policy->Forget(slot.frame);
+        block.parked = false;
+        dirty_frames.Remove(slot.frame);
+        block.queued = false;
+    }
+    block.latch.lock();
+    return slot.frame;
+}
+
+// The page stays mapped while it is written back, so that nobody reads the
+// old contents from disk meanwhile; lookups wait on the latch.
+void BufferManager::EvictFrame(int frame)
+{
+    Block & block = blocks[frame];
+    if (block.file_id < 0)
+        return;
+    FileStats::Bump(block.stats->evictions);
+    block.Flush();
+    {
+        Partition & partition = PartitionOf(block.file_id, block.block_id);
+        std::lock_guard<std::mutex> guard(partition.latch);
+        partition.table.Erase(block.file_id, block.block_id);
+    }
+    block.Reset();
+}
+
+bool BufferManager::InstallPage(int frame, int file_id, int block_id)
+{
+    Partition & partition = PartitionOf(file_id, block_id);
+    std::lock_guard<std::mutex> guard(partition.latch);
+    if (partition.table.Find(file_id, block_id) >= 0)
+        return false;
+    Block & block = blocks[frame];
+    block.files = &files;
+    block.stats = &files.Stats(file_id);
+    block.file_id = file_id;
+    block.block_id = block_id;
+    block.loading = true;
+    block.pins = 1;
+    NotePinned();
+    partition.table.Insert(file_id, block_id, frame);
+    return true;
+}
+
+void BufferManager::FinishLoad(int frame)
+{
+    Block & block = blocks[frame];
+    block.loading = false;
+    block.latch.unlock();
+    std::lock_guard<std::mutex> guard(pool_latch);
+    block.referenced = false;
+    block.parked = false;
+    policy->Admit(frame, PageTable::Key(block.file_id, block.block_id));
+}
+
+void BufferManager::ReleaseClaim(int frame)
+{
+    Block & block = blocks[frame];
+    block.pins = 0;
+    std::lock_guard<std::mutex> guard(pool_latch);
+    if (claim_waiters > 0)
+        frame_released.notify_all();
+    // pinned or claimed again meanwhile: the new owner updates the policy
+    if (block.pins != 0 or block.file_id < 0)
+        return;
+    block.parked = false;
+    policy->Restore(frame);
+    policy->SetEvictable(frame, true);
+}
+
+void BufferManager::ReleaseFrame(int frame)
+{
+    Block & block = blocks[frame];
+    block.latch.unlock();
+    std::lock_guard<std::mutex> guard(pool_latch);
+    free_frames.push_back(frame);
+    block.pins = 0;
+    if (claim_waiters > 0)
+        frame_released.notify_all();
+}
+
+void BufferManager::BackgroundWriter()
+{
+    std::vector<int> batch;
+    std::unique_lock<std::mutex> lock(pool_latch);
+    while (not stop_writer)
+    {
+        writer_wakeup.wait_for(lock, writer_interval);
+        // one pass over the list: frames dirtied again come back when
+        // they are unpinned
+        int budget = dirty_frames.Size();
+        while (budget > 0 and not stop_writer and dirty_frames.Size() > dirty_target)
+        {
+            batch.clear();
+            for (; budget > 0 and int(batch.size()) < batch_frames
+                 and dirty_frames.Size() > dirty_target; budget--)
+            {
+                int frame = dirty_frames.PopFront();
+                blocks[frame].queued = false;
+                if (Pin(frame))
+                    batch.push_back(frame);
+            }
+            lock.unlock();
+            WriteBack(batch);
+            for (int frame : batch)
+                Unpin(frame);
+            lock.lock();
+        }
+    }
+}
+
+void BufferManager::ReadAhead(int file_id, int block_id, int past_the_end, bool into_pool)
+{
+    if (readahead <= 0 or not io_pool)
+        return;
+    Sequence & seq = sequences[file_id % Sequences];
+    if (seq.file_id.load(std::memory_order_relaxed) != file_id)
+    {
+        seq.file_id.store(file_id, std::memory_order_relaxed);
+        seq.last_block.store(-1, std::memory_order_relaxed);
+        seq.run.store(0, std::memory_order_relaxed);
+        seq.prefetched_until.store(0, std::memory_order_relaxed);
+    }
+    // hits on the same block write nothing
+    int last_block = seq.last_block.load(std::memory_order_relaxed);
+    if (block_id == last_block
+        or not seq.last_block.compare_exchange_strong(last_block, block_id, std::memory_order_relaxed))
+        return;
+    int run;
+    if (block_id == last_block + 1)
+        run = seq.run.fetch_add(1, std::memory_order_relaxed) + 1;
+    else
+    {
+        run = 0;
+        seq.run.store(0, std::memory_order_relaxed);
+        seq.prefetched_until.store(0, std::memory_order_relaxed);
+    }
+    // request the next window once the reader is half way through this one
+    int prefetched_until = seq.prefetched_until.load(std::memory_order_relaxed);
+    int first = std::max(block_id + 1, prefetched_until);
+    if (run < 2 or first - block_id > readahead / 2)
+        return;
+    int last = std::min(block_id + 1 + readahead, past_the_end);
+    if (first >= last
+        or not seq.prefetched_until.compare_exchange_strong(prefetched_until, last, std::memory_order_relaxed))
+        return;
+    io_pool->Submit([this, file_id, first, last, into_pool] { Prefetch(file_id, first, last - first, into_pool); });
+}
+
+void BufferManager::Prefetch(int file_id, int first, int count, bool into_pool)
+{
+    std::shared_lock<std::shared_timed_mutex> guard(file_latch);
+    // the file may have been removed, and even created again shorter, since
+    // the request was queued
+    if (stop_prefetch or not files.IsOpen(file_id))
+        return;
+    count = std::min(count, files.BlockCount(file_id) - first);
+    if (count <= 0)
+        return;
+    int fd = files.Descriptor(file_id);
+    if (not files.IsDirect(file_id))
+        FileManager::WillNeed(fd, first, count);
+    for (int block_id = first; into_pool and block_id < first + count and not stop_prefetch; block_id++)
+    {
+        if (not PrefetchPage(file_id, block_id))
+            break;
+    }
+}
+
+bool BufferManager::PrefetchPage(int file_id, int block_id)
+{
+    Partition & partition = PartitionOf(file_id, block_id);
+    {
+        std::lock_guard<std::mutex> guard(partition.latch);
+        if (partition.table.Find(file_id, block_id) >= 0)
+            return true;
+    }
+    int frame = GetVictim();
+    if (frame < 0)
+        return false;
+    EvictFrame(frame);
+    if (not InstallPage(frame, file_id, block_id))
+    {
+        ReleaseFrame(frame);
+        return true;
+    }
+    files.ReadBlock(file_id, block_id, blocks[frame].content);
+    FileStats::Bump(blocks[frame].stats->prefetches);
+    FinishLoad(frame);
+    Unpin(frame);
+    return true;
+}
+
+void BufferManager::SaveWarmUp()
+{
+    if (warmup_file.empty())
+        return;
+    // no other thread is left, so the frames can be read without latches
+    std::vector<int> frames;
+    policy->Ranking(frames);
+    std::ofstream out(warmup_file);
+    for (int frame : frames)
+    {
+        if (blocks[frame].file_id >= 0)
+            out << files.FileName(blocks[frame].file_id) << ' ' << blocks[frame].block_id << '\n';
+    }
+}
+
+void BufferManager::WarmUp(const std::vector<std::pair<std::string, int>> & pages)
+{
+    // The list is hottest first, and each page goes to the most recently
+    // used end of the policy as it is loaded: the hottest ones that fit are
+    // loaded last, so that they are the last to go again.
+    std::size_t count;
+    {
+        std::lock_guard<std::mutex> guard(pool_latch);
+        count = std::min(pages.size(), free_frames.size());
+    }
+    for (std::size_t i = count; i-- > 0; )
+    {
+        auto & page = pages[i];
+        if (stop_prefetch)
+            return;
+        {
+            std::lock_guard<std::mutex> guard(pool_latch);
+            if (free_frames.empty())
+                return;
+        }
+        // the file may have been dropped since the list was saved
+        std::shared_lock<std::shared_timed_mutex> guard(file_latch);
+        int file_id = files.FileID(page.first);
+        if (not files.IsOpen(file_id) and not std::ifstream(page.first).good())
+            continue;
+        if (page.second < files.BlockCount(file_id) and not PrefetchPage(file_id, page.second))
+            return;
+    }
+}
+
+std::unique_ptr<BufferRing> BufferManager::ScanRing(int file_id)
+{
+    if (ring_blocks <= 0 or files.BlockCount(file_id) <= ring_threshold)
+        return nullptr;
+    return std::unique_ptr<BufferRing>(new BufferRing(ring_blocks));
 }
@@ -2,13 +2,29 @@
 #define BUFFERMANAGER_H_
 
 #include <iostream>
-#include <map>
+#include <vector>
+#include <cstdint>
 #include <utility>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
 #include "MiniType.h"
-#include <array>
+#include "FileManager.h"
+#include "ReplacementPolicy.h"
+#include "ThreadPool.h"
 
 class BufferManager;
 
+// Descriptor of one buffer pool frame. The 4 KB payload itself lives in the
+// buffer manager's arena; content points at this frame's slice of it.
+//
+// A frame is in use while its pin count is positive and the page in it
+// cannot be evicted then. Pinning does not protect the payload: readers hold
+// Latch() shared and writers hold it exclusively while they touch it.
 class Block
 {
 public:
@@ -17,41 +33,334 @@ public:
 	Block & Write(void * source, int offset, std::size_t size);
 	Block & Read(void * dest, int offset, std::size_t size);
 	Block & Flush();
-    char & operator[](int i) { return content[i]; }
     char * head_pointer(bool write) {if (write) dirty = true; return content;}
+    std::shared_timed_mutex & Latch() { return latch; }
 private:
-    Block & SetMRUtime(int t);
+    // pins value of a frame one thread is evicting or loading alone
+    static const int Claimed = -1;
     Block & Reset();
-    Block & Connect(const std::string & filename, int block_id, bool get_content=false);
-    Block & SetPinned(bool pinned);
-	bool dirty;
-    char content[MINI_TYPE::BlockSize];
-    std::string filename;
+    Block & Load(FileManager & files, int file_id, int block_id, bool append);
+    // Add a pin unless the frame is claimed; before is the old pin count.
+    bool TryPin(int & before);
+    // Claim the frame if nobody has it pinned.
+    bool TryClaim();
+	std::atomic<bool> dirty;
+    char * content;
+    FileManager * files;
+    FileStats * stats;      // counters of the file the page belongs to
+    // the page held by the frame; only changes while the frame is claimed
+    int file_id;
     int block_id;
-    int MRUtime;
-    bool pinned;
+    std::atomic<int> pins;
+    std::atomic<bool> loading;  // its payload is still being read
+    // hit since the policy last looked at the frame: the hit path only
+    // sets this, and GetVictim gives the frame a second chance for it
+    std::atomic<bool> referenced;
+    // offered by the policy while pinned and set aside; the last unpin
+    // makes it evictable again
+    std::atomic<bool> parked;
+    std::atomic<bool> queued;   // on the background writer's dirty list
+    std::shared_timed_mutex latch;
 	
     friend BufferManager;
 };
 
+// Open-addressing (linear probing) map from (file id, block id) to a frame
+// index in the buffer pool. Deletion uses backward shifting, so there are no
+// tombstones and probe sequences stay short. It doubles when half full.
+class PageTable
+{
+public:
+    explicit PageTable(int frames);
+    int Find(int file_id, int block_id) const;
+    void Insert(int file_id, int block_id, int frame);
+    void Erase(int file_id, int block_id);
+    // call f(key, frame) for every mapped page
+    template <typename F> void ForEach(F f) const
+    {
+        for (auto & slot : slots)
+            if (slot.frame >= 0)
+                f(slot.key, slot.frame);
+    }
+    static std::uint64_t Key(int file_id, int block_id);
+    static std::uint64_t Hash(std::uint64_t key);
+private:
+    struct Slot
+    {
+        std::uint64_t key;
+        int frame;       // -1 if the slot is empty
+    };
+    std::size_t Home(std::uint64_t key) const { return Hash(key) & mask; }
+    void Grow();
+    std::vector<Slot> slots;
+    std::size_t mask;
+    std::size_t count = 0;
+};
+
+// Frames private to one large sequential scan. Once the ring is full, the
+// scan's misses recycle its oldest frame instead of evicting pages other
+// queries use, so the scan keeps at most size() frames of the pool.
+class BufferRing
+{
+public:
+    explicit BufferRing(int size) : slots(size) {}
+    int size() const { return int(slots.size()); }
+private:
+    struct Slot
+    {
+        int frame = -1;
+        std::uint64_t key = 0;      // page the ring loaded into frame
+    };
+    std::vector<Slot> slots;
+    std::size_t next = 0;
+    friend BufferManager;
+};
+
+// Snapshot of the buffer pool counters, as shown by `show buffer stats`.
+// Files that were never accessed through the pool are left out.
+struct BufferStats
+{
+    struct File
+    {
+        std::string name;
+        std::uint64_t hits = 0, misses = 0, prefetches = 0, evictions = 0;
+        std::uint64_t read_bytes = 0, write_bytes = 0, write_calls = 0;
+    };
+    int frames = 0;
+    int pinned = 0;
+    int pinned_high_water = 0;
+    int dirty = 0;
+    std::uint64_t hits = 0, misses = 0, prefetches = 0, evictions = 0;
+    std::uint64_t write_backs = 0;      // pages written
+    std::uint64_t write_calls = 0;      // pwrite/pwritev calls doing it
+    std::uint64_t read_bytes = 0, write_bytes = 0;
+    std::vector<File> files;
+    std::string scan_kernels;   // set by the caller: ScanFilter::KernelName()
+    void PrintText(std::ostream & out) const;
+    void PrintJson(std::ostream & out) const;
+};
+
+// Startup configuration of the buffer manager. FromEnvironment() applies the
+// MINISQL_* overrides on top of the defaults below.
+struct BufferOptions
+{
+    // MINISQL_BUFFER_POLICY=lru|clock|2q
+    ReplacementPolicy::Kind policy = ReplacementPolicy::LRU;
+    // MINISQL_BUFFER_BLOCKS=<frames> or MINISQL_BUFFER_SIZE=<bytes>[K|M|G]
+    int pool_blocks = MINI_TYPE::MaxBlocks;
+    // MINISQL_BUFFER_HUGEPAGES=1: back the arena with huge pages if possible
+    bool huge_pages = false;
+    // MINISQL_DIRECT_IO=1: open files with O_DIRECT, making the pool the
+    // only cache of their pages; the arena's frames are page aligned
+    bool direct_io = false;
+    // MINISQL_DIRTY_RATIO: the background writer cleans unpinned dirty
+    // frames until at most this fraction of the pool is dirty; 1 disables it
+    double dirty_ratio = 0.1;
+    // MINISQL_WRITER_INTERVAL: milliseconds between background writer rounds
+    int writer_interval_ms = 100;
+    // MINISQL_READAHEAD: blocks to prefetch ahead of a sequential reader; 0 disables
+    int readahead_blocks = 16;
+    // MINISQL_IO_THREADS: threads performing the prefetch reads
+    int io_threads = 2;
+    // MINISQL_RING_BLOCKS: frames in a scan's private ring, at most an
+    // eighth of the pool; 0 disables rings
+    int ring_blocks = 32;
+    // MINISQL_RING_THRESHOLD: files longer than this many blocks are scanned
+    // through a ring; -1 means a quarter of the pool
+    int ring_threshold = -1;
+    // MINISQL_WARMUP_FILE: where the resident pages are listed at shutdown,
+    // hottest first, to be read back in at the next startup; off unless set
+    std::string warmup_file;
+    static BufferOptions FromEnvironment();
+};
+
+// Every public member may be called from several threads at once. Locks, in
+// the order they may nest: file_latch, a page latch (held while loading or
+// evicting a frame), a page table partition, pool_latch. No lock is held
+// across disk I/O except those two latches.
 class BufferManager
 {
 public:
-    BufferManager(){};
-    ~BufferManager() {FlushAllBlocks();}
-	Block * GetBlock(const std::string & filename, int block_id);
-    void FreeBlock(const std::string & filename, int block_id);
+    explicit BufferManager(const BufferOptions & options = BufferOptions::FromEnvironment());
+    BufferManager(const BufferManager &) = delete;
+    BufferManager & operator=(const BufferManager &) = delete;
+    ~BufferManager();
+    // Intern a file name. The id is stable for the lifetime of the manager,
+    // so callers on the hot path should look it up once and keep it.
+    int FileID(const std::string & filename);
+    // A pin on one page, dropped when the guard is destroyed, reset or
+    // assigned another page. Guards can be moved but not copied, so every
+    // pin has exactly one owner. A guard on a mapped page pins nothing.
+    class PageGuard
+    {
+    public:
+        PageGuard() {}
+        PageGuard(PageGuard && other) { *this = std::move(other); }
+        PageGuard & operator=(PageGuard && other);
+        PageGuard(const PageGuard &) = delete;
+        PageGuard & operator=(const PageGuard &) = delete;
+        ~PageGuard() { Release(); }
+        // The page's bytes; write = true marks a pooled page dirty.
+        char * Data(bool write) const { return frame >= 0 ? bm->blocks[frame].head_pointer(write) : data; }
+        // Readers hold it shared and writers exclusively while they touch the page.
+        std::shared_timed_mutex & Latch() const { return *latch; }
+        explicit operator bool() const { return data != nullptr; }
+        void Release();
+    private:
+        PageGuard(BufferManager * bm, int frame)
+            : bm(bm), frame(frame), data(bm->blocks[frame].content), latch(&bm->blocks[frame].Latch()) {}
+        PageGuard(char * data, std::shared_timed_mutex * latch) : data(data), latch(latch) {}
+        BufferManager * bm = nullptr;
+        int frame = -1;     // -1 for a mapped page
+        char * data = nullptr;
+        std::shared_timed_mutex * latch = nullptr;
+        friend BufferManager;
+    };
+    // Pin a page, reading it first if needed. The block past the end of the
+    // file is only handed out on an append, as a new zeroed page.
+	PageGuard GetBlock(int file_id, int block_id, BufferRing * ring = nullptr, bool append = false);
+	PageGuard GetBlock(const std::string & filename, int block_id) {return GetBlock(FileID(filename), block_id);}
+    // Pin a page through hint, the frame it was last handed out in: a pin
+    // and a check of the page held there, with no page table lookup or
+    // read-ahead. If the page has left the frame it is fetched with
+    // GetBlock, and hint set to its new frame.
+    PageGuard GetHintedBlock(int file_id, int block_id, int & hint, bool append = false);
+    // A page of a memory-mapped table, read and written in place in the
+    // mapping rather than through the pool. A file must be accessed either
+    // this way or with GetBlock, never both.
+    PageGuard GetMappedBlock(int file_id, int block_id, bool append = false);
 	void CreateFile(const std::string & filename);
 	void RemoveFile(const std::string & filename);
-    int PastTheEndBlockID(const std::string & filename);
+    int PastTheEndBlockID(int file_id);
+    int PastTheEndBlockID(const std::string & filename) {return PastTheEndBlockID(FileID(filename));}
     void FlushAllBlocks();
+    // A ring for a sequential scan of the file, or nullptr if the file is
+    // small enough to be scanned through the shared pool.
+    std::unique_ptr<BufferRing> ScanRing(int file_id);
+    BufferStats Stats();
 private:
+    static const int Partitions = 16;
+    struct Partition
+    {
+        explicit Partition(int frames) : table(frames) {}
+        std::mutex latch;
+        PageTable table;
+    };
+    Partition & PartitionOf(int file_id, int block_id);
     
-    using MapType = std::map<std::pair<std::string, int>, Block &>;
-    MapType block_map;
-	std::array<Block, MINI_TYPE::MaxBlocks> blocks;
-	Block & GetLRU();
-	int access_counter = 1;
+    FileManager files;
+    std::vector<std::unique_ptr<Partition>> partitions;
+    // page-aligned payloads of all frames, blocks[i].content = arena + i * BlockSize
+    char * arena;
+    std::size_t arena_bytes;
+	std::vector<Block> blocks;
+
+    // Pin the frame holding a page, waiting for it to finish loading; -1
+    // if the page is not in the pool.
+    int PinResident(int file_id, int block_id);
+    // Count a hit on a pinned frame and mark it referenced for the policy.
+    void NoteHit(Block & block);
+    // Every pin is taken by Pin or InstallPage and dropped by Unpin, which
+    // keep count of the pinned frames.
+    bool Pin(int frame);
+    void Unpin(int frame);
+    void NotePinned();
+    std::atomic<int> pinned_frames;
+    std::atomic<int> pinned_high_water;
+    // Mapped pages have no frame; their latches are striped by page.
+    static const int MappedLatches = 64;
+    std::shared_timed_mutex mapped_latches[MappedLatches];
+
+    // Frames to load a page into come back claimed with their latch held.
+    int GetVictim();
+    int RecycleRingFrame(BufferRing & ring);
+    // Write back and unmap the page in a claimed frame.
+    void EvictFrame(int frame);
+    // Map the page to a claimed frame, which becomes pinned and loading;
+    // false if another thread mapped the page first.
+    bool InstallPage(int frame, int file_id, int block_id);
+    void FinishLoad(int frame);
+    // Let go of a claimed frame whose page stays, back in the policy.
+    void ReleaseClaim(int frame);
+    // Put a claimed frame that did not get a page on the free list.
+    void ReleaseFrame(int frame);
+    // Unmap every page of a file, claiming each frame once its pins are gone.
+    void DropPages(int file_id);
+    // Claim the frame holding a page once its pins are gone; false if the
+    // page has left the frame meanwhile.
+    bool ClaimPage(int file_id, int block_id, int frame);
+    // Write back the dirty pages among frames, which the caller has pinned.
+    // They are sorted by file and block, and each run of adjacent blocks is
+    // written with one pwritev while the run's latches are held shared.
+    void WriteBack(std::vector<int> & frames);
+    // most frames pinned at once by a write-back batch
+    int batch_frames;
+    int ring_blocks;
+    int ring_threshold;
+
+    // pool_latch guards the replacement state: policy, free_frames,
+    // dirty_frames and the writer's state. A hit does not take it: a pin
+    // and an unpin only touch the frame's atomics, unless the unpin has to
+    // hand a parked frame back to the policy or list a newly dirty one.
+    std::mutex pool_latch;
+    std::unique_ptr<ReplacementPolicy> policy;
+    // frames that hold no page, used before asking the policy for a victim
+    std::vector<int> free_frames;
+    // unpinned frames known to be dirty, oldest first
+    FrameList dirty_frames;
+    // Unpin and the claim releases wake ClaimPage when it waits for a
+    // frame to come free.
+    std::condition_variable frame_released;
+    std::atomic<int> claim_waiters{0};
+    // Held shared by prefetch tasks, which hold descriptors, and by
+    // RemoveFile while it waits for the file's pages to come free; exclusive
+    // while a file is created or closed.
+    std::shared_timed_mutex file_latch;
+
+    // Background writer. It pins a batch of the oldest dirty frames and
+    // writes them back together; the pins keep the frames from being
+    // reused until the writes have finished.
+    void BackgroundWriter();
+    std::condition_variable writer_wakeup;
+    std::thread writer;
+    int dirty_target;
+    std::chrono::milliseconds writer_interval;
+    bool stop_writer = false;
+
+    // Read-ahead. Three consecutive block numbers make a file sequential;
+    // from then on the io_pool keeps readahead blocks ahead of the reader
+    // loaded, in frames marked loading until their read completes. The
+    // state is striped by file and kept in atomics, so readers of
+    // different files do not meet; a file sharing a stripe with another
+    // merely restarts its run. Racing readers of one file may lose an
+    // update, which only delays a window.
+    struct Sequence
+    {
+        std::atomic<int> file_id{-1};
+        std::atomic<int> last_block{-1};
+        std::atomic<int> run{0};
+        std::atomic<int> prefetched_until{0};   // blocks before this are already requested
+    };
+    static const int Sequences = 64;
+    // Scans through a ring only get the kernel hint: loading their
+    // read-ahead into shared frames would defeat the ring.
+    void ReadAhead(int file_id, int block_id, int past_the_end, bool into_pool);
+    void Prefetch(int file_id, int first, int count, bool into_pool);
+    // Read a page into a frame unless it is resident; false if every frame
+    // is pinned.
+    bool PrefetchPage(int file_id, int block_id);
+    Sequence sequences[Sequences];
+    int readahead;
+    std::atomic<bool> stop_prefetch;
+    std::unique_ptr<ThreadPool> io_pool;
+
+    // Warm-up. The destructor saves the resident pages in the policy's
+    // order; the next manager reloads them on the io_pool, into free frames
+    // only, so the pages queries have already brought in stay, and coldest
+    // first, so that the policy ranks them as before.
+    void SaveWarmUp();
+    void WarmUp(const std::vector<std::pair<std::string, int>> & pages);
+    std::string warmup_file;
 };
 
 #endif
@@ -0,0 +1,322 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "FileManager.h"
+
+const std::size_t FileManager::MapReserve;
+const std::size_t FileManager::MapStep;
+
+FileManager::~FileManager()
+{
+    for (int file_id = 0; file_id < int(files.size()); file_id++)
+        Close(file_id);
+}
+
+int FileManager::FileID(const std::string & filename)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    auto iter = file_ids.find(filename);
+    if (iter != file_ids.end())
+        return iter->second;
+    int file_id = int(files.size());
+    files.emplace_back();
+    files.back().name = filename;
+    file_ids.insert(std::make_pair(filename, file_id));
+    return file_id;
+}
+
+std::string FileManager::FileName(int file_id)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    return files[file_id].name;
+}
+
+bool FileManager::IsOpen(int file_id)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    return files[file_id].fd >= 0;
+}
+
+bool FileManager::IsDirect(int file_id)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    return files[file_id].fd >= 0 and files[file_id].direct;
+}
+
+int FileManager::Descriptor(int file_id)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    return Open(file_id);
+}
+
+int FileManager::Open(int file_id)
+{
+    File & file = files[file_id];
+    if (file.fd < 0)
+    {
+        file.fd = OpenDescriptor(file, O_RDWR);
+        if (file.fd < 0)
+        {
+            std::cerr << "File " + file.name + " does not exists!\n";
+            std::exit(0);
+        }
+        struct stat st;
+        if (fstat(file.fd, &st) != 0)
+        {
+            std::cerr << "Failed to get file past-the-end.\n";
+            std::exit(0);
+        }
+        file.block_count = int(st.st_size / MINI_TYPE::BlockSize);
+    }
+    return file.fd;
+}
+
+int FileManager::OpenDescriptor(File & file, int flags)
+{
+    file.direct = false;
+#ifdef O_DIRECT
+    if (direct_io)
+    {
+        int fd = open(file.name.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0 or errno != EINVAL)
+        {
+            file.direct = fd >= 0;
+            return fd;
+        }
+    }
+#endif
+    return open(file.name.c_str(), flags, 0644);
+}
+
+int FileManager::BlockCount(int file_id)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    Open(file_id);
+    return files[file_id].block_count;
+}
+
+void FileManager::Extend(int file_id, int block_count)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    Open(file_id);
+    if (block_count > files[file_id].block_count)
+        files[file_id].block_count = block_count;
+}
+
+void FileManager::Close(int file_id)
+{
+    if (files[file_id].mapping)
+    {
+        munmap(files[file_id].mapping, MapReserve);
+        files[file_id].mapping = nullptr;
+        files[file_id].mapped_bytes = 0;
+    }
+    if (files[file_id].fd >= 0)
+    {
+        close(files[file_id].fd);
+        files[file_id].fd = -1;
+    }
+    files[file_id].block_count = -1;
+}
+
+char * FileManager::MapBlock(int file_id, int block_id, bool append)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    int fd = Open(file_id);
+    File & file = files[file_id];
+    std::size_t end = std::size_t(block_id + 1) * MINI_TYPE::BlockSize;
+    if (block_id > file.block_count or (block_id == file.block_count and not append) or end > MapReserve)
+    {
+        std::cerr << "Block id out of bound.\n";
+        std::exit(0);
+    }
+    if (block_id == file.block_count)
+    {
+        if (ftruncate(fd, off_t(end)) != 0)
+        {
+            std::cerr << "Cannot write file " + file.name + "!\n";
+            std::exit(0);
+        }
+        file.block_count = block_id + 1;
+    }
+    if (not file.mapping)
+    {
+        void * base = mmap(nullptr, MapReserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            std::cerr << "Cannot map file " + file.name + ".\n";
+            std::exit(0);
+        }
+        file.mapping = static_cast<char *>(base);
+    }
+    if (end > file.mapped_bytes)
+    {
+        // whole steps, past the end of the file if need be: those pages are
+        // only touched after the file has grown over them
+        std::size_t length = std::min(MapReserve, (end + MapStep - 1) / MapStep * MapStep);
+        if (mmap(file.mapping + file.mapped_bytes, length - file.mapped_bytes, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, off_t(file.mapped_bytes)) == MAP_FAILED)
+        {
+            std::cerr << "Cannot map file " + file.name + ".\n";
+            std::exit(0);
+        }
+        file.mapped_bytes = length;
+    }
+    return file.mapping + std::size_t(block_id) * MINI_TYPE::BlockSize;
+}
+
+FileStats & FileManager::Stats(int file_id)
+{
+    std::lock_guard<std::mutex> guard(latch);
+    return files[file_id].stats;
+}
+
+void FileManager::ReadBlock(int file_id, int block_id, char * dest)
+{
+    if (not ReadAt(Descriptor(file_id), block_id, dest))
+    {
+        std::cerr << "Cannot read file " + FileName(file_id) + ".\n";
+        std::exit(0);
+    }
+    FileStats::Bump(Stats(file_id).reads);
+}
+
+bool FileManager::ReadAt(int fd, int block_id, char * dest)
+{
+    off_t offset = off_t(block_id) * MINI_TYPE::BlockSize;
+    std::size_t done = 0;
+    while (done < std::size_t(MINI_TYPE::BlockSize))
+    {
+        ssize_t n = pread(fd, dest + done, MINI_TYPE::BlockSize - done, offset + done);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    std::memset(dest + done, 0, MINI_TYPE::BlockSize - done);
+    return true;
+}
+
+void FileManager::WriteBlock(int file_id, int block_id, const char * source)
+{
+    if (not WriteAt(Descriptor(file_id), block_id, source))
+    {
+        std::cerr << "Cannot write file " + FileName(file_id) + "!\n";
+        std::exit(0);
+    }
+    FileStats & stats = Stats(file_id);
+    FileStats::Bump(stats.writes);
+    FileStats::Bump(stats.write_calls);
+}
+
+void FileManager::WriteBlocks(int file_id, int block_id, char * const * pages, int count)
+{
+    if (not WriteBlocksAt(Descriptor(file_id), block_id, pages, count))
+    {
+        std::cerr << "Cannot write file " + FileName(file_id) + "!\n";
+        std::exit(0);
+    }
+    FileStats & stats = Stats(file_id);
+    FileStats::Bump(stats.writes, count);
+    FileStats::Bump(stats.write_calls);
+}
+
+bool FileManager::WriteAt(int fd, int block_id, const char * source)
+{
+    off_t offset = off_t(block_id) * MINI_TYPE::BlockSize;
+    std::size_t done = 0;
+    while (done < std::size_t(MINI_TYPE::BlockSize))
+    {
+        ssize_t n = pwrite(fd, source + done, MINI_TYPE::BlockSize - done, offset + done);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+bool FileManager::WriteBlocksAt(int fd, int block_id, char * const * pages, int count)
+{
+#ifdef IOV_MAX
+    const std::size_t max_iov = IOV_MAX;
+#else
+    const std::size_t max_iov = 1024;
+#endif
+    std::vector<iovec> iov(count);
+    for (int i = 0; i < count; i++)
+    {
+        iov[i].iov_base = pages[i];
+        iov[i].iov_len = MINI_TYPE::BlockSize;
+    }
+    off_t offset = off_t(block_id) * MINI_TYPE::BlockSize;
+    std::size_t first = 0;
+    while (first < iov.size())
+    {
+        ssize_t n = pwritev(fd, &iov[first], int(std::min(iov.size() - first, max_iov)), offset);
+        if (n < 0 and errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        offset += n;
+        // drop the buffers written in full and trim a partly written one
+        while (n > 0)
+        {
+            if (std::size_t(n) >= iov[first].iov_len)
+            {
+                n -= iov[first].iov_len;
+                first++;
+            }
+            else
+            {
+                iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + n;
+                iov[first].iov_len -= n;
+                n = 0;
+            }
+        }
+    }
+    return true;
+}
+
+void FileManager::WillNeed(int fd, int block_id, int count)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, off_t(block_id) * MINI_TYPE::BlockSize, off_t(count) * MINI_TYPE::BlockSize,
+                  POSIX_FADV_WILLNEED);
+#endif
+}
+
+void FileManager::Create(const std::string & filename)
+{
+    int file_id = FileID(filename);
+    std::lock_guard<std::mutex> guard(latch);
+    Close(file_id);
+    files[file_id].fd = OpenDescriptor(files[file_id], O_RDWR | O_CREAT | O_TRUNC);
+    if (files[file_id].fd < 0)
+    {
+        std::cerr << "Cannot create file " + filename + "!\n";
+        std::exit(0);
+    }
+    files[file_id].block_count = 0;
+}
+
+void FileManager::Remove(const std::string & filename)
+{
+    int file_id = FileID(filename);
+    std::lock_guard<std::mutex> guard(latch);
+    Close(file_id);
+    std::remove(filename.c_str());
+}
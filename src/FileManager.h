@@ -0,0 +1,112 @@
+#ifndef FILEMANAGER_H_
+#define FILEMANAGER_H_
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include "MiniType.h"
+
+// Buffer and I/O counters of one file. They are bumped with relaxed atomic
+// adds, so a snapshot taken while queries run is only roughly consistent.
+struct FileStats
+{
+    std::atomic<std::uint64_t> hits{0};         // GetBlock found the page
+    std::atomic<std::uint64_t> misses{0};       // GetBlock loaded the page
+    std::atomic<std::uint64_t> prefetches{0};   // read-ahead loaded the page
+    std::atomic<std::uint64_t> evictions{0};
+    std::atomic<std::uint64_t> reads{0};        // blocks read
+    std::atomic<std::uint64_t> writes{0};       // blocks written
+    std::atomic<std::uint64_t> write_calls{0};  // pwrite/pwritev calls
+    static void Bump(std::atomic<std::uint64_t> & counter, std::uint64_t n = 1)
+    {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+};
+
+// Owns the table/index files used by the buffer manager. Each file name is
+// interned into a small id, and one descriptor per file is kept open so that
+// a block transfer is a single pread/pwrite at block_id * BlockSize.
+// All members may be called from several threads; the transfers themselves
+// run outside the file table's mutex.
+//
+// With direct_io the files are opened with O_DIRECT, bypassing the kernel's
+// page cache, so every buffer passed in must be BlockSize aligned. A file
+// system that refuses O_DIRECT gets ordinary buffered descriptors.
+class FileManager
+{
+public:
+    explicit FileManager(bool direct_io = false) : direct_io(direct_io) {}
+    FileManager(const FileManager &) = delete;
+    FileManager & operator=(const FileManager &) = delete;
+    ~FileManager();
+    int FileID(const std::string & filename);
+    std::string FileName(int file_id);
+    // Read a whole block; the part past the end of the file reads as zeros.
+    void ReadBlock(int file_id, int block_id, char * dest);
+    void WriteBlock(int file_id, int block_id, const char * source);
+    // Write count pages to consecutive blocks from block_id in one call.
+    void WriteBlocks(int file_id, int block_id, char * const * pages, int count);
+    // Positioned I/O and hints on an already open descriptor; false on
+    // error. Unlike the members above they touch no shared state.
+    static bool ReadAt(int fd, int block_id, char * dest);
+    static bool WriteAt(int fd, int block_id, const char * source);
+    // Write count pages to consecutive blocks from block_id with pwritev.
+    static bool WriteBlocksAt(int fd, int block_id, char * const * pages, int count);
+    static void WillNeed(int fd, int block_id, int count);
+    // Create (or truncate) a file and keep it open.
+    void Create(const std::string & filename);
+    void Remove(const std::string & filename);
+    // Descriptor of an existing file, opened on first use.
+    int Descriptor(int file_id);
+    bool IsOpen(int file_id);
+    // The file's descriptor bypasses the page cache, so kernel read-ahead
+    // hints are useless for it.
+    bool IsDirect(int file_id);
+    // Length of the file in blocks. It is read with fstat() once when the
+    // file is opened and maintained in memory from then on.
+    int BlockCount(int file_id);
+    // Record that the file now extends to block_count blocks (a block past
+    // the end was handed out); the bytes may reach the disk later.
+    void Extend(int file_id, int block_count);
+    // Address of a block in a shared mapping of the file, the alternative
+    // to ReadBlock/WriteBlock for memory-mapped tables. The mapping sits in
+    // an address range reserved when it is first used, so a block never
+    // moves while the file is open. On an append, the block one past the
+    // end is added to the file.
+    char * MapBlock(int file_id, int block_id, bool append);
+    // Counters of the file; the reference stays valid as files are added.
+    FileStats & Stats(int file_id);
+    // call f(name, stats) for every file ever named
+    template <typename F> void ForEachFile(F f)
+    {
+        std::lock_guard<std::mutex> guard(latch);
+        for (auto & file : files)
+            f(file.name, file.stats);
+    }
+private:
+    struct File
+    {
+        std::string name;
+        int fd = -1;
+        int block_count = -1;   // -1 until the file has been opened
+        bool direct = false;    // opened with O_DIRECT
+        FileStats stats;
+        char * mapping = nullptr;       // MapReserve bytes of address space
+        std::size_t mapped_bytes = 0;   // prefix of it backed by the file
+    };
+    static const std::size_t MapReserve = std::size_t(64) << 30;
+    static const std::size_t MapStep = std::size_t(1) << 20;
+    int Open(int file_id);
+    void Close(int file_id);
+    // open(2) with O_DIRECT added when asked for and accepted
+    int OpenDescriptor(File & file, int flags);
+    const bool direct_io;
+    std::mutex latch;
+    std::unordered_map<std::string, int> file_ids;
+    std::deque<File> files;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include <fstream>
+#include "FreeSpaceMap.hpp"
+
+FreeSpaceMap::FreeSpaceMap(int records_per_block, int block_count)
+    : records_per_block(records_per_block), capacity(records_per_block * block_count),
+      words((std::size_t(capacity) + 63) / 64, 0)
+{
+    first_free_word = words.size();
+}
+
+int FreeSpaceMap::Take()
+{
+    for (; first_free_word < words.size(); first_free_word++)
+    {
+        std::uint64_t & word = words[first_free_word];
+        if (word)
+        {
+            int bit = __builtin_ctzll(word);
+            word &= word - 1;
+            return int(first_free_word * 64) + bit;
+        }
+    }
+    int record_index = capacity;
+    AddBlock();
+    words[record_index / 64] &= ~(std::uint64_t(1) << (record_index % 64));
+    return record_index;
+}
+
+void FreeSpaceMap::Release(int record_index)
+{
+    while (record_index >= capacity)
+        AddBlock();
+    words[record_index / 64] |= std::uint64_t(1) << (record_index % 64);
+    if (std::size_t(record_index / 64) < first_free_word)
+        first_free_word = record_index / 64;
+}
+
+void FreeSpaceMap::AddBlock()
+{
+    int first = capacity;
+    capacity += records_per_block;
+    words.resize((std::size_t(capacity) + 63) / 64, 0);
+    for (int i = first; i < capacity; i++)
+        words[i / 64] |= std::uint64_t(1) << (i % 64);
+    if (std::size_t(first / 64) < first_free_word)
+        first_free_word = first / 64;
+}
+
+bool FreeSpaceMap::Load(const std::string & filename, int block_count)
+{
+    std::ifstream in(filename, std::ios::binary);
+    int saved_records_per_block = 0, saved_capacity = -1;
+    in.read(reinterpret_cast<char *>(&saved_records_per_block), sizeof(int));
+    in.read(reinterpret_cast<char *>(&saved_capacity), sizeof(int));
+    if (not in.good() or saved_records_per_block != records_per_block
+        or saved_capacity != records_per_block * block_count)
+        return false;
+    std::vector<std::uint64_t> saved_words((std::size_t(saved_capacity) + 63) / 64);
+    in.read(reinterpret_cast<char *>(saved_words.data()), saved_words.size() * sizeof(std::uint64_t));
+    if (not in.good())
+        return false;
+    capacity = saved_capacity;
+    words.swap(saved_words);
+    first_free_word = 0;
+    return true;
+}
+
+void FreeSpaceMap::Save(const std::string & filename) const
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&records_per_block), sizeof(int));
+    out.write(reinterpret_cast<const char *>(&capacity), sizeof(int));
+    out.write(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(std::uint64_t));
+}
+
+// Saved page maps start with this instead of a positive records_per_block,
+// so neither kind of map loads from the other's file.
+static const int PageMapTag = -1;
+
+PageSpaceMap::PageSpaceMap(int smallest_request, int block_count)
+    : smallest_request(smallest_request), free_bytes(block_count, 0)
+{
+    first_roomy = free_bytes.size();
+}
+
+int PageSpaceMap::Find(int bytes)
+{
+    while (first_roomy < free_bytes.size() and free_bytes[first_roomy] < smallest_request)
+        first_roomy++;
+    for (std::size_t block_id = first_roomy; block_id < free_bytes.size(); block_id++)
+    {
+        if (free_bytes[block_id] >= bytes)
+            return int(block_id);
+    }
+    return int(free_bytes.size());
+}
+
+void PageSpaceMap::Set(int block_id, int free)
+{
+    if (std::size_t(block_id) >= free_bytes.size())
+        free_bytes.resize(block_id + 1, 0);
+    free_bytes[block_id] = std::uint16_t(free);
+    if (free >= smallest_request and std::size_t(block_id) < first_roomy)
+        first_roomy = block_id;
+}
+
+bool PageSpaceMap::Load(const std::string & filename, int block_count)
+{
+    std::ifstream in(filename, std::ios::binary);
+    int tag = 0, saved_count = -1;
+    in.read(reinterpret_cast<char *>(&tag), sizeof(int));
+    in.read(reinterpret_cast<char *>(&saved_count), sizeof(int));
+    if (not in.good() or tag != PageMapTag or saved_count != block_count)
+        return false;
+    std::vector<std::uint16_t> saved(saved_count);
+    in.read(reinterpret_cast<char *>(saved.data()), saved.size() * sizeof(std::uint16_t));
+    if (not in.good())
+        return false;
+    free_bytes.swap(saved);
+    first_roomy = 0;
+    return true;
+}
+
+void PageSpaceMap::Save(const std::string & filename) const
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    int count = int(free_bytes.size());
+    out.write(reinterpret_cast<const char *>(&PageMapTag), sizeof(int));
+    out.write(reinterpret_cast<const char *>(&count), sizeof(int));
+    out.write(reinterpret_cast<const char *>(free_bytes.data()), free_bytes.size() * sizeof(std::uint16_t));
+}
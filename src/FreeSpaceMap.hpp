@@ -0,0 +1,53 @@
+#ifndef FreeSpaceMap_hpp
+#define FreeSpaceMap_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Which record slots of a table are free, one bit per slot of the blocks it
+// covers. Take() hands out the lowest free slot so that churn refills the
+// front of the file instead of growing it; when every slot is used it covers
+// one more block, which the caller's write then appends to the file.
+class FreeSpaceMap
+{
+public:
+    // The slots of the first block_count blocks start out used; release the
+    // empty ones to rebuild a map by scanning the table.
+    FreeSpaceMap(int records_per_block, int block_count);
+    int Take();
+    void Release(int record_index);
+    // Read a map saved by Save(); false if the file is missing or does not
+    // match a table of block_count blocks.
+    bool Load(const std::string & filename, int block_count);
+    void Save(const std::string & filename) const;
+private:
+    void AddBlock();
+    int records_per_block;
+    int capacity;                       // slots covered
+    std::vector<std::uint64_t> words;   // set bit = free slot
+    std::size_t first_free_word = 0;    // no free slot in earlier words
+};
+
+// Free bytes of each page of a slotted table, the counterpart of
+// FreeSpaceMap for records of varying length. Find() is first fit, so churn
+// refills the front of the file too; pages before first_roomy cannot take
+// even the smallest record and are not looked at again until one changes.
+class PageSpaceMap
+{
+public:
+    // The first block_count pages start out full; Set() their real free
+    // space to rebuild a map by scanning the table.
+    PageSpaceMap(int smallest_request, int block_count);
+    // first page with at least bytes free; the page count for a new page
+    int Find(int bytes);
+    void Set(int block_id, int free_bytes);
+    bool Load(const std::string & filename, int block_count);
+    void Save(const std::string & filename) const;
+private:
+    int smallest_request;
+    std::vector<std::uint16_t> free_bytes;
+    std::size_t first_roomy = 0;
+};
+
+#endif /* FreeSpaceMap_hpp */
@@ -17,6 +17,18 @@ void Interpreter::MainInteractive() {
                 if (!infile.good())
                     throw MINI_TYPE::SyntaxError("File " + command.fileName + " does not exist.");
 
+                // Consecutive inserts into one table are run as a batch. Their
+                // messages come out together once the batch is written, so
+                // the output of a script is grouped per batch.
+                std::string batchTable;
+                std::vector<std::vector<MINI_TYPE::SqlValue>> batchRows;
+                auto flushBatch = [&]() {
+                    if (batchRows.empty())
+                        return;
+                    API::InsertBatch(batchTable, batchRows, false, [] { cout << "Query OK" << endl; });
+                    batchRows.clear();
+                };
+
                 while (!infile.eof()) {
 
                     string lines;
@@ -32,9 +44,27 @@ void Interpreter::MainInteractive() {
                         }
                     }
 
-                    if (API::Execute(Parse(lines)))
+                    MINI_TYPE::SqlCommand fileCommand;
+                    try {
+                        fileCommand = Parse(lines);
+                    } catch (MINI_TYPE::SyntaxError &) {
+                        flushBatch();
+                        throw;
+                    }
+
+                    if (fileCommand.commandType == MINI_TYPE::InsertCmd && fileCommand.valueRows.size() == 1) {
+                        if (fileCommand.tableName != batchTable || batchRows.size() >= MaxBatchRows)
+                            flushBatch();
+                        batchTable = fileCommand.tableName;
+                        batchRows.push_back(fileCommand.valueRows.front());
+                        continue;
+                    }
+
+                    flushBatch();
+                    if (API::Execute(fileCommand))
                         cout << "Query OK" << endl;
                 }
+                flushBatch();
             } else if (API::Execute(command))
                 cout << "Query OK" << endl;
         }
@@ -69,20 +99,79 @@ MINI_TYPE::SqlCommand Interpreter::ReadCommand() {
     return Parse(lines);
 }
 
-MINI_TYPE::SqlCommand Interpreter::Parse(std::string input) {
+std::vector<std::string> Interpreter::Tokenize(std::string input) {
     using namespace std;
 
-    auto token = strtok(const_cast<char *>(input.c_str()), ",;()\t\n\' ‘’");
+    // A quoted string is part of one token, separators and all: a "..."
+    // string keeps its quotes, as char values are stored with them, and a
+    // '...' string does not.
+    static const string separators = ",;()\t\n ‘’";
 
     vector<string> tokens;
+    string token;
+    bool inToken = false;
+
+    for (size_t i = 0; i < input.size(); i++) {
+        char c = input[i];
+        if (c == '"' || c == '\'') {
+            size_t end = input.find(c, i + 1);
+            if (end == string::npos)
+                end = input.size();
+            if (c == '"')
+                token += input.substr(i, end + 1 - i);
+            else
+                token += input.substr(i + 1, end - i - 1);
+            inToken = true;
+            i = end;
+        } else if (separators.find(c) != string::npos) {
+            if (inToken)
+                tokens.push_back(token);
+            token.clear();
+            inToken = false;
+        } else {
+            token += c;
+            inToken = true;
+        }
+    }
+    if (inToken)
+        tokens.push_back(token);
+
+    return tokens;
+}
 
-    while (token) {
-        if (strcmp(token, "") != 0) {
-            tokens.emplace_back(token);
-            token = strtok(nullptr, ",;()\t\n\' ‘’");
+std::vector<std::size_t> Interpreter::GroupSizes(const std::string &input) {
+    std::vector<std::size_t> sizes;
+    int depth = 0;
+    bool separated = true;
+    std::size_t start = 0;
+
+    for (std::size_t i = 0; i < input.size(); i++) {
+        char c = input[i];
+        if (c == '"' || c == '\'') {
+            std::size_t end = input.find(c, i + 1);
+            i = end == std::string::npos ? input.size() : end;
+        } else if (depth == 0 && !separated) {
+            // a group is followed by a comma or the end of the statement
+            if (c == ',')
+                separated = true;
+            else if (!isspace(static_cast<unsigned char>(c)))
+                throw MINI_TYPE::SyntaxError("Invalid value list.");
+        } else if (c == '(' && depth++ == 0) {
+            start = i + 1;
+        } else if (c == ')' && depth > 0 && --depth == 0) {
+            sizes.push_back(Tokenize(input.substr(start, i - start)).size());
+            separated = false;
         }
     }
 
+    return sizes;
+}
+
+MINI_TYPE::SqlCommand Interpreter::Parse(std::string input) {
+    using namespace std;
+
+    vector<string> tokens = Tokenize(input);
+
     if (tokens[0] == "create") {
         if (tokens[1] == "table")
             return ParseCreateTable(tokens);
@@ -103,7 +192,7 @@ MINI_TYPE::SqlCommand Interpreter::Parse(std::string input) {
         return ParseSelect(tokens);
 
     if (tokens[0] == "insert")
-        return ParseInsert(tokens);
+        return ParseInsert(tokens, GroupSizes(input));
 
     if (tokens[0] == "delete")
         return ParseDelete(tokens);
@@ -114,6 +203,9 @@ MINI_TYPE::SqlCommand Interpreter::Parse(std::string input) {
     if (tokens[0] == "execfile")
         return ParseExecFile(tokens);
 
+    if (tokens[0] == "show")
+        return ParseShow(tokens);
+
     throw MINI_TYPE::SyntaxError("Invalid input");
 }
 
@@ -134,6 +226,18 @@ MINI_TYPE::SqlCommand Interpreter::ParseCreateTable(std::vector<std::string> tok
             continue;
         }
 
+        if (tokens[i] == "storage" && static_cast<std::size_t>(i) + 1 < tokens.size() && (tokens[i + 1] == "mmap" || tokens[i + 1] == "pool")) {
+            sqlCommand.tableInfo.storage = tokens[i + 1] == "mmap" ? MappedStorage : PooledStorage;
+            i += 2;
+            continue;
+        }
+
+        if (tokens[i] == "layout" && static_cast<std::size_t>(i) + 1 < tokens.size() && (tokens[i + 1] == "slotted" || tokens[i + 1] == "fixed")) {
+            sqlCommand.tableInfo.layout = tokens[i + 1] == "slotted" ? SlottedLayout : FixedLayout;
+            i += 2;
+            continue;
+        }
+
         Attribute attribute;
         attribute.name = tokens[i];
 
@@ -257,7 +361,8 @@ MINI_TYPE::SqlCommand Interpreter::ParseSelect(std::vector<std::string> tokens)
     return sqlCommand;
 }
 
-MINI_TYPE::SqlCommand Interpreter::ParseInsert(std::vector<std::string> tokens) {
+MINI_TYPE::SqlCommand Interpreter::ParseInsert(std::vector<std::string> tokens,
+                                               const std::vector<std::size_t> &groupSizes) {
     using namespace MINI_TYPE;
 
     if (tokens.size() <= 4)
@@ -267,7 +372,27 @@ MINI_TYPE::SqlCommand Interpreter::ParseInsert(std::vector<std::string> tokens)
     sqlCommand.commandType = InsertCmd;
     sqlCommand.tableName = tokens[2];
 
+    std::vector<std::size_t> rowSizes(1, tokens.size() - 4);
+    if (groupSizes.size() > 1) {
+        std::size_t total = 0;
+        for (auto size : groupSizes) {
+            if (size == 0)
+                throw SyntaxError("Invalid value list.");
+            total += size;
+        }
+        if (total != tokens.size() - 4)
+            throw SyntaxError("Invalid value list.");
+        rowSizes = groupSizes;
+    }
+
+    auto rowSize = rowSizes.begin();
+    sqlCommand.valueRows.emplace_back();
     for (int pointer = 4; tokens.size() > pointer; pointer++) {
+        if (sqlCommand.valueRows.back().size() == *rowSize) {
+            sqlCommand.valueRows.emplace_back();
+            rowSize++;
+        }
+
         SqlValue sqlValue;
 
         try {
@@ -280,7 +405,7 @@ MINI_TYPE::SqlCommand Interpreter::ParseInsert(std::vector<std::string> tokens)
 
         sqlValue.str = tokens[pointer];
 
-        sqlCommand.valueArray.push_back(sqlValue);
+        sqlCommand.valueRows.back().push_back(sqlValue);
     }
 
     return sqlCommand;
@@ -345,4 +470,22 @@ MINI_TYPE::SqlCommand Interpreter::ParseExecFile(std::vector<std::string> tokens
     sqlCommand.fileName = tokens[1];
 
     return sqlCommand;
-}
\ No newline at end of file
+}
+
+MINI_TYPE::SqlCommand Interpreter::ParseShow(std::vector<std::string> tokens) {
+    using namespace MINI_TYPE;
+
+    if (tokens.size() < 3 || tokens[1] != "buffer" || tokens[2] != "stats")
+        throw SyntaxError("Invalid show command.");
+
+    SqlCommand sqlCommand;
+    sqlCommand.commandType = ShowBufferStatsCmd;
+    sqlCommand.format = "text";
+
+    if (tokens.size() == 4 && tokens[3] == "json")
+        sqlCommand.format = "json";
+    else if (tokens.size() != 3)
+        throw SyntaxError("Invalid show command.");
+
+    return sqlCommand;
+}
@@ -4,16 +4,25 @@
 #include "MiniType.h"
 #include "API.h"
 
-#include <cstring>
+#include <cctype>
 
 class Interpreter {
 public:
+    // most rows execfile collects into one insert batch
+    static const std::size_t MaxBatchRows = 4096;
+
     static void MainInteractive();
 
     static MINI_TYPE::SqlCommand ReadCommand();
 
     static MINI_TYPE::SqlCommand Parse(std::string input);
 
+    static std::vector<std::string> Tokenize(std::string input);
+
+    // Number of tokens in each top-level parenthesized group of input; quoted
+    // strings are skipped, and a group must be followed by a comma or the end.
+    static std::vector<std::size_t> GroupSizes(const std::string &input);
+
     static MINI_TYPE::SqlCommand ParseCreateTable(std::vector<std::string> tokens);
 
     static MINI_TYPE::SqlCommand ParseCreateIndex(std::vector<std::string> tokens);
@@ -24,13 +33,18 @@ public:
 
     static MINI_TYPE::SqlCommand ParseSelect(std::vector<std::string> tokens);
 
-    static MINI_TYPE::SqlCommand ParseInsert(std::vector<std::string> tokens);
+    // groupSizes splits the values into rows; with one group or none they
+    // are a single row
+    static MINI_TYPE::SqlCommand ParseInsert(std::vector<std::string> tokens,
+                                             const std::vector<std::size_t> &groupSizes = {});
 
     static MINI_TYPE::SqlCommand ParseDelete(std::vector<std::string> tokens);
 
     static MINI_TYPE::SqlCommand ParseExit(std::vector<std::string> tokens);
 
     static MINI_TYPE::SqlCommand ParseExecFile(std::vector<std::string> tokens);
+
+    static MINI_TYPE::SqlCommand ParseShow(std::vector<std::string> tokens);
 };
 
 
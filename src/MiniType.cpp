@@ -57,15 +57,15 @@ namespace MINI_TYPE
     void SqlValue::ReadFromMemory(const char * source, int byte_offset)
     {
         size_t size = type.TypeSize();
-        char temp[MaxChar + 1];
+        const char * end;
         switch(type.type)
         {
             case MiniInt: std::memcpy(&i, source + byte_offset, size); break;
             case MiniFloat: std::memcpy(&f, source + byte_offset, size); break;
             case MiniChar:
-                std::memset(temp, 0, MaxChar + 1);
-                std::memcpy(temp, source + byte_offset, size);
-                str = temp;
+                // up to the first 0, or all of char(n)
+                end = static_cast<const char *>(std::memchr(source + byte_offset, 0, size));
+                str.assign(source + byte_offset, end ? end - (source + byte_offset) : size);
                 break;
         }
     }
@@ -183,7 +183,9 @@ namespace MINI_TYPE
         
         for (auto &index : tableInfo.indices)
             out << index << ' ';
-        
+
+        out << (tableInfo.storage == MappedStorage ? "mmap" : "pool") << ' '
+            << (tableInfo.layout == SlottedLayout ? "slotted" : "fixed");
         out << std::endl;
         return out;
     }
@@ -206,6 +208,13 @@ namespace MINI_TYPE
             in >> index;
             tableInfo.indices.insert(index);
         }
+
+        // absent in catalogs written before storage modes and layouts existed
+        std::string storage, layout;
+        if (in >> storage)
+            tableInfo.storage = storage == "mmap" ? MappedStorage : PooledStorage;
+        if (in >> layout)
+            tableInfo.layout = layout == "slotted" ? SlottedLayout : FixedLayout;
         return in;
     }
     
@@ -354,7 +363,7 @@ namespace MINI_TYPE
     }
 
     // Condition
-    bool Condition::Test(SqlValue val) const
+    bool Condition::Test(const SqlValue & val) const
     {
         switch (op)
         {
@@ -366,18 +375,25 @@ namespace MINI_TYPE
             case Operator::NotEqual: return val != value;
         }
     }
+    // the value of the attribute in the record, read in place
+    static const SqlValue & Field(const TableInfo & table, const Record & record, const std::string & attribute)
+    {
+        for (std::size_t i = 0; i < table.attributes.size(); i++)
+            if (table.attributes[i].name == attribute)
+                return record.values[i];
+        std::cerr << "Attribute " + attribute + " does not exists!\n";
+        std::exit(0);
+    }
     bool Test(const std::vector<Condition> & conditions, const TableInfo & table, const Record & record)
     {
         for (const auto & cond : conditions)
-            if (not cond.Test(record.Extract(table, cond.attributeName).values[0]))
+            if (not cond.Test(Field(table, record, cond.attributeName)))
                 return false;
         return true;
     }
     bool Test(Condition & condition, const TableInfo & table, const Record & record)
     {
-        if (not condition.Test(record.Extract(table, condition.attributeName).values[0]))
-            return false;
-        return true;
+        return condition.Test(Field(table, record, condition.attributeName));
     }
     
     
@@ -16,12 +16,13 @@ namespace MINI_TYPE
 {
     // nameing conventions
     inline std::string TableFileName(const std::string & table_name) {return table_name;}
+    inline std::string FreeSpaceFileName(const std::string & table_name) {return table_name + ".fsm";}
     inline std::string IndexFileName(const std::string & index_name) {return index_name;}
     inline std::string IndexName(const std::string & table_name, const std::string & attribute_name) {return table_name + "_" + attribute_name;}
     
     
     const int BlockSize = 4096;
-    const int MaxBlocks = 128;
+    const int MaxBlocks = 128;          // default buffer pool size, see BufferOptions
     const char Empty = 0;
     const char NonEmpty = 1;
     const int MaxChar = 256;
@@ -33,16 +34,32 @@ namespace MINI_TYPE
     	MiniChar
 	};
 
+	// Where a table's pages live: in the buffer pool, or read and written in
+	// place in a memory mapping of the table file.
+	enum StorageMode {
+	    PooledStorage,
+	    MappedStorage
+	};
+
+	// How records are laid out in a page: at a fixed stride of
+	// record_length + 1, or packed behind a slot directory with char values
+	// stored at their actual length.
+	enum RecordLayout {
+	    FixedLayout,
+	    SlottedLayout
+	};
+
 	enum CommandType {
 	    CreateTableCmd,    // arg: TableInfo
 	    DropTableCmd,      // arg: TableName
 	    CreateIndexCmd,    // arg: IndexInfo
 	    DropIndexCmd,      // arg: IndexName
 	    SelectCmd,         // arg: TableName, CondArray
-	    InsertCmd,         // arg: TableName, ValueArray
+	    InsertCmd,         // arg: TableName, ValueRows
 	    DeleteCmd,         // arg: TableName, CondArray
 	    QuitCmd,           // arg:
-	    ExecfileCmd        // arg: FileName
+	    ExecfileCmd,       // arg: FileName
+	    ShowBufferStatsCmd // arg: Format
 	};
 
 	enum Operator {
@@ -116,6 +133,8 @@ namespace MINI_TYPE
 		int record_length = 0;
 		int record_count = 0;
 		std::map<std::string, std::string> indices;
+		StorageMode storage = PooledStorage;
+		RecordLayout layout = FixedLayout;
         Attribute FetchAttribute(const std::string & attribute_name);
     };
     
@@ -166,7 +185,7 @@ namespace MINI_TYPE
         Condition(){}
 		Condition(std::string attr, Operator ope, SqlValue val) : op(ope), value(val), attributeName(attr) {}
 
-		bool Test(SqlValue val) const;
+		bool Test(const SqlValue & val) const;
 		Operator op;
 		SqlValue value;
 		std::string attributeName;
@@ -179,8 +198,9 @@ namespace MINI_TYPE
         std::string tableName;
         std::string indexName;
         std::string fileName;
+        std::string format;
         std::vector<Condition> condArray;
-        std::vector<SqlValue> valueArray;
+        std::vector<std::vector<SqlValue>> valueRows;
         std::vector<std::string> attrList;
     };
 
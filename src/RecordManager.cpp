@@ -1,68 +1,345 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include "RecordManager.hpp"
 #include "MiniType.h"
 #include "BufferManager.h"
 #include "IndexManager.hpp"
 
-RecordManager::RecordIterator::RecordIterator(const MINI_TYPE::TableInfo & table, int record_index, BufferManager * bm)
+// A slotted page starts with the number of directory entries and the offset
+// of its lowest record (0 for an empty page, so a fresh zeroed block is one).
+// The directory follows, one {offset, length} entry per slot with offset 0
+// for an empty slot, and the records are packed down from the end of the
+// page. A record keeps its int and float values at full size and a char
+// value as its bytes followed by a 0 unless it fills its char(n).
+static const int SlottedHeader = 4;
+static const int SlotEntrySize = 4;
+
+static int LoadShort(const char * at)
+{
+    std::uint16_t value;
+    std::memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+static void StoreShort(char * at, int value)
+{
+    std::uint16_t stored = std::uint16_t(value);
+    std::memcpy(at, &stored, sizeof(stored));
+}
+
+static int SlotCount(const char * page)
+{
+    return LoadShort(page);
+}
+
+static int DataStart(const char * page)
+{
+    int data_start = LoadShort(page + 2);
+    return data_start == 0 ? MINI_TYPE::BlockSize : data_start;
+}
+
+static void SetDataStart(char * page, int data_start)
+{
+    StoreShort(page + 2, data_start == MINI_TYPE::BlockSize ? 0 : data_start);
+}
+
+static int EncodeSlotted(const MINI_TYPE::Record & record, char * dest)
+{
+    int length = 0;
+    for (auto & value : record.values)
+    {
+        if (value.type.type != MINI_TYPE::MiniChar)
+        {
+            if (dest)
+                value.WriteToMemory(dest, length);
+            length += int(value.type.TypeSize());
+            continue;
+        }
+        int size = int(std::min(std::strlen(value.str.c_str()), value.type.char_size));
+        if (dest)
+            std::memcpy(dest + length, value.str.data(), size);
+        length += size;
+        if (size < int(value.type.char_size))
+        {
+            if (dest)
+                dest[length] = 0;
+            length++;
+        }
+    }
+    return length;
+}
+
+int RecordManager::RecordsPerBlock(const MINI_TYPE::TableInfo & table)
+{
+    if (table.layout != MINI_TYPE::SlottedLayout)
+        return MINI_TYPE::BlockSize / (table.record_length + 1);
+    int shortest = 0;
+    for (auto & attribute : table.attributes)
+        shortest += attribute.type.type == MINI_TYPE::MiniChar ? std::min<int>(1, int(attribute.type.char_size))
+                                                               : int(attribute.type.TypeSize());
+    return (MINI_TYPE::BlockSize - SlottedHeader) / (SlotEntrySize + std::max(1, shortest));
+}
+
+int RecordManager::RecordIterator::SlottedLength(const MINI_TYPE::Record & record)
+{
+    return EncodeSlotted(record, nullptr);
+}
+
+RecordManager::RecordIterator::RecordIterator(const MINI_TYPE::TableInfo & table, int record_index, BufferManager * bm,
+                                              Access access)
 {
-    this->table = table;
+    this->table = &table;
     this->bm = bm;
     this->record_index = record_index;
     record_length = table.record_length + 1;
-    records_per_block = MINI_TYPE::BlockSize / record_length;
+    records_per_block = RecordsPerBlock(table);
     block_id = record_index / records_per_block;
     in_block_record_index = record_index - block_id * records_per_block;
-    past_the_end_block_id = bm->PastTheEndBlockID(table.name);
-    
-    block = bm->GetBlock(MINI_TYPE::TableFileName(table.name), block_id);
+    file_id = bm->FileID(MINI_TYPE::TableFileName(table.name));
+    past_the_end_block_id = bm->PastTheEndBlockID(file_id);
+    mapped = table.storage == MINI_TYPE::MappedStorage;
+    slotted = table.layout == MINI_TYPE::SlottedLayout;
+    appending = access == Append;
+    if (not slotted)
+        RecordView::FixedOffsets(table, offsets);
+    if (access == Scan and not mapped)
+        ring = bm->ScanRing(file_id);
+    // reads never grow the file
+    if (access != Scan or block_id < past_the_end_block_id)
+        block = Fetch(block_id);
 }
 
-RecordManager::RecordIterator::~RecordIterator()
+void RecordManager::RecordIterator::Seek(const MINI_TYPE::TableInfo & table, int record_index)
 {
-    bm->FreeBlock(table.name, block_id);
+    this->table = &table;
+    this->record_index = record_index;
+    int new_block_id = record_index / records_per_block;
+    in_block_record_index = record_index - new_block_id * records_per_block;
+    // a released insert cursor pins its block again
+    if (new_block_id != block_id or (appending and not block))
+    {
+        block.Release();
+        block_id = new_block_id;
+        block = Fetch(block_id);
+    }
 }
 
-bool RecordManager::RecordIterator::Read(MINI_TYPE::Record & record)
+void RecordManager::RecordIterator::Release()
 {
-    if ((*block)[in_block_record_index * record_length] == MINI_TYPE::Empty)
-        return false;
-    else
+    block.Release();
+}
+
+BufferManager::PageGuard RecordManager::RecordIterator::Fetch(int block_id)
+{
+    if (mapped)
+        return bm->GetMappedBlock(file_id, block_id, appending);
+    if (appending)
+        return bm->GetHintedBlock(file_id, block_id, frame_hint, true);
+    return bm->GetBlock(file_id, block_id, ring.get(), appending);
+}
+
+char * RecordManager::RecordIterator::SlotEntry(char * page) const
+{
+    if (in_block_record_index >= SlotCount(page))
+        return nullptr;
+    return page + SlottedHeader + in_block_record_index * SlotEntrySize;
+}
+
+const char * RecordManager::RecordIterator::Locate()
+{
+    char * page = block.Data(false);
+    if (not slotted)
     {
-        record.Conform(table);
-        int byte_offset = 1;
-        for (auto & value : record.values)
-        {
-            value.ReadFromMemory(block->head_pointer(false), in_block_record_index * record_length + byte_offset);
-            byte_offset += value.type.TypeSize();
-        }
-        return true;
+        const char * record = page + in_block_record_index * record_length;
+        return *record == MINI_TYPE::Empty ? nullptr : record;
     }
+    char * entry = SlotEntry(page);
+    if (not entry or LoadShort(entry) == 0)
+        return nullptr;
+    const char * record = page + LoadShort(entry);
+    RecordView::SlottedOffsets(*table, record, offsets);
+    return record;
+}
+
+bool RecordManager::RecordIterator::Read(MINI_TYPE::Record & record)
+{
+    return Visit([&record](const RecordView & view) { view.Materialize(record); });
+}
+bool RecordManager::RecordIterator::TryWrite(const MINI_TYPE::Record & record) const
+{
+    std::lock_guard<std::shared_timed_mutex> guard(block.Latch());
+    if (block.Data(false)[in_block_record_index * record_length] != MINI_TYPE::Empty)
+        return false;
+    WriteLatched(record);
+    return true;
 }
 void RecordManager::RecordIterator::Write(const MINI_TYPE::Record & record) const
 {
+    std::lock_guard<std::shared_timed_mutex> guard(block.Latch());
+    WriteLatched(record);
+}
+void RecordManager::RecordIterator::WriteLatched(const MINI_TYPE::Record & record) const
+{
+    char * page = block.Data(true);
     int byte_offset = 1;
     for (auto & value : record.values)
     {
-        value.WriteToMemory(block->head_pointer(true), in_block_record_index * record_length + byte_offset);
-        (*block)[in_block_record_index * record_length] = MINI_TYPE::NonEmpty;
+        value.WriteToMemory(page, in_block_record_index * record_length + byte_offset);
         byte_offset += value.type.TypeSize();
     }
+    page[in_block_record_index * record_length] = MINI_TYPE::NonEmpty;
+}
+bool RecordManager::RecordIterator::Insert(const MINI_TYPE::Record & record)
+{
+    int length = SlottedLength(record);
+    std::lock_guard<std::shared_timed_mutex> guard(block.Latch());
+    char * page = block.Data(false);
+    int slot_count = SlotCount(page);
+    int slot = 0;
+    while (slot < slot_count and LoadShort(page + SlottedHeader + slot * SlotEntrySize) != 0)
+        slot++;
+    if (slot == records_per_block)
+        return false;
+    int directory_end = SlottedHeader + std::max(slot + 1, slot_count) * SlotEntrySize;
+    int data_start = DataStart(page) - length;
+    if (data_start < directory_end)
+        return false;
+    page = block.Data(true);
+    EncodeSlotted(record, page + data_start);
+    StoreShort(page + SlottedHeader + slot * SlotEntrySize, data_start);
+    StoreShort(page + SlottedHeader + slot * SlotEntrySize + 2, length);
+    SetDataStart(page, data_start);
+    StoreShort(page, std::max(slot + 1, slot_count));
+    in_block_record_index = slot;
+    record_index = block_id * records_per_block + slot;
+    return true;
+}
+
+int RecordManager::RecordIterator::FreeBytes() const
+{
+    std::shared_lock<std::shared_timed_mutex> guard(block.Latch());
+    const char * page = block.Data(false);
+    return DataStart(page) - SlottedHeader - SlotCount(page) * SlotEntrySize;
 }
+
 void RecordManager::RecordIterator::Delete()
 {
-    (*block)[in_block_record_index * record_length] = MINI_TYPE::Empty;
+    std::lock_guard<std::shared_timed_mutex> guard(block.Latch());
+    if (not slotted)
+    {
+        block.Data(true)[in_block_record_index * record_length] = MINI_TYPE::Empty;
+        return;
+    }
+    char * page = block.Data(false);
+    char * entry = SlotEntry(page);
+    if (not entry or LoadShort(entry) == 0)
+        return;
+    page = block.Data(true);
+    entry = SlotEntry(page);
+    int offset = LoadShort(entry), length = LoadShort(entry + 2);
+    int data_start = DataStart(page);
+    std::memmove(page + data_start + length, page + data_start, offset - data_start);
+    int slot_count = SlotCount(page);
+    for (int slot = 0; slot < slot_count; slot++)
+    {
+        char * other = page + SlottedHeader + slot * SlotEntrySize;
+        int other_offset = LoadShort(other);
+        if (other_offset != 0 and other_offset < offset)
+            StoreShort(other, other_offset + length);
+    }
+    StoreShort(entry, 0);
+    StoreShort(entry + 2, 0);
+    SetDataStart(page, data_start + length);
+    // empty entries at the end of the directory go back to the free space
+    while (slot_count > 0 and LoadShort(page + SlottedHeader + (slot_count - 1) * SlotEntrySize) == 0)
+        slot_count--;
+    StoreShort(page, slot_count);
+}
+
+void RecordManager::RecordIterator::Filter(const std::vector<BoundCondition> & conditions)
+{
+    filters.clear();
+    if (slotted)
+        return;
+    for (auto & condition : conditions)
+        if (ScanFilter::Vectorizable(condition))
+            filters.push_back(condition);
+    if (not filters.empty())
+    {
+        selected.assign(ScanFilter::MaskWords, 0);
+        if (block)
+            SelectSlots();
+    }
+}
+
+void RecordManager::RecordIterator::SelectSlots()
+{
+    std::shared_lock<std::shared_timed_mutex> guard(block.Latch());
+    const char * page = block.Data(false);
+    ScanFilter::Occupied(page, record_length, records_per_block, selected.data());
+    for (auto & condition : filters)
+        ScanFilter::Apply(condition, page, record_length, records_per_block, selected.data());
 }
 
 bool RecordManager::RecordIterator::Next(bool expand)
 {
-    past_the_end_block_id = bm->PastTheEndBlockID(table.name);
+    // a scan of a table that was empty when it started
+    if (not block)
+        return false;
+    past_the_end_block_id = bm->PastTheEndBlockID(file_id);
+    if (not filters.empty() and not expand)
+    {
+        // on to the next selected slot, page by page
+        int slot = in_block_record_index + 1;
+        while (true)
+        {
+            for (; slot < records_per_block; slot++)
+            {
+                std::uint64_t word = selected[slot / 64] >> (slot % 64);
+                if (word == 0)
+                {
+                    slot = slot / 64 * 64 + 63;
+                    continue;
+                }
+                slot += __builtin_ctzll(word);
+                break;
+            }
+            if (slot < records_per_block)
+            {
+                in_block_record_index = slot;
+                record_index = block_id * records_per_block + slot;
+                return block_id < past_the_end_block_id;
+            }
+            if (block_id + 1 >= past_the_end_block_id)
+                return false;
+            block.Release();
+            block_id++;
+            block = Fetch(block_id);
+            SelectSlots();
+            slot = 0;
+        }
+    }
     record_index++;
     in_block_record_index++;
-    if (in_block_record_index >= records_per_block)
+    bool past_directory = false;
+    if (slotted)
     {
+        std::shared_lock<std::shared_timed_mutex> guard(block.Latch());
+        past_directory = in_block_record_index >= SlotCount(block.Data(false));
+    }
+    if (in_block_record_index >= records_per_block or past_directory)
+    {
+        // a scan stops at the last block rather than appending an empty one
+        if (block_id + 1 >= past_the_end_block_id and not expand)
+            return false;
+        // let go of this block first so a ring can reuse its frame
+        block.Release();
         block_id++;
         in_block_record_index = 0;
-        block = bm->GetBlock(table.name, block_id);
+        record_index = block_id * records_per_block;
+        block = Fetch(block_id);
     }
     if (block_id >= past_the_end_block_id and not expand)
         return false;
@@ -70,15 +347,79 @@ bool RecordManager::RecordIterator::Next(bool expand)
         return true;
 }
 
+RecordManager::~RecordManager()
+{
+    for (auto & map : free_space)
+        map.second->Save(MINI_TYPE::FreeSpaceFileName(map.first));
+    for (auto & map : page_space)
+        map.second->Save(MINI_TYPE::FreeSpaceFileName(map.first));
+}
+
+FreeSpaceMap & RecordManager::FreeSpace(const MINI_TYPE::TableInfo & table)
+{
+    auto iter = free_space.find(table.name);
+    if (iter != free_space.end())
+        return *iter->second;
+    int records_per_block = RecordsPerBlock(table);
+    int block_count = bm->PastTheEndBlockID(MINI_TYPE::TableFileName(table.name));
+    std::unique_ptr<FreeSpaceMap> map(new FreeSpaceMap(records_per_block, block_count));
+    std::string filename = MINI_TYPE::FreeSpaceFileName(table.name);
+    if (not map->Load(filename, block_count) and block_count > 0)
+    {
+        RecordIterator iter(table, 0, bm, RecordIterator::Scan);
+        while (true)
+        {
+            if (not iter.Visit([](const RecordView &) {}))
+                map->Release(iter.CurrentIndex());
+            if (not iter.Next())
+                break;
+        }
+    }
+    std::remove(filename.c_str());
+    return *free_space.emplace(table.name, std::move(map)).first->second;
+}
+
+PageSpaceMap & RecordManager::PageSpace(const MINI_TYPE::TableInfo & table)
+{
+    auto iter = page_space.find(table.name);
+    if (iter != page_space.end())
+        return *iter->second;
+    int records_per_block = RecordsPerBlock(table);
+    int shortest = (MINI_TYPE::BlockSize - SlottedHeader) / records_per_block;
+    int block_count = bm->PastTheEndBlockID(MINI_TYPE::TableFileName(table.name));
+    std::unique_ptr<PageSpaceMap> map(new PageSpaceMap(shortest, block_count));
+    std::string filename = MINI_TYPE::FreeSpaceFileName(table.name);
+    if (not map->Load(filename, block_count) and block_count > 0)
+    {
+        RecordIterator iter(table, 0, bm, RecordIterator::Scan);
+        for (int block_id = 0; block_id < block_count; block_id++)
+        {
+            iter.Seek(table, block_id * records_per_block);
+            map->Set(block_id, iter.FreeBytes());
+        }
+    }
+    std::remove(filename.c_str());
+    return *page_space.emplace(table.name, std::move(map)).first->second;
+}
+
 bool RecordManager::CreateTableFile(const MINI_TYPE::TableInfo & table)
 {
+   insert_cursors.erase(table.name);
    bm->CreateFile(MINI_TYPE::TableFileName(table.name));
+   free_space.erase(table.name);
+   page_space.erase(table.name);
+   std::remove(MINI_TYPE::FreeSpaceFileName(table.name).c_str());
    return true;
 }
 
 bool RecordManager::DeleteTableFile(const MINI_TYPE::TableInfo & table)
 {
+   // the cursor refers to the file being removed
+   insert_cursors.erase(table.name);
    bm->RemoveFile(table.name);
+   free_space.erase(table.name);
+   page_space.erase(table.name);
+   std::remove(MINI_TYPE::FreeSpaceFileName(table.name).c_str());
    return true;
 }
 
@@ -87,24 +428,15 @@ bool RecordManager::BuildIndex(MINI_TYPE::TableInfo & table, const MINI_TYPE::At
     std::string index_name = MINI_TYPE::IndexName(table.name, attribute.name);
     table.indices[attribute.name] = index_name;
     im->CreateIndex(index_name, attribute.type);
-    RecordIterator iter(table, 0, bm);
+    std::size_t column = 0;
+    while (column < table.attributes.size() and table.attributes[column].name != attribute.name)
+        column++;
+    RecordIterator iter(table, 0, bm, RecordIterator::Scan);
     while (true)
     {
-        MINI_TYPE::Record record;
-        if (iter.Read(record))
-        {
-            MINI_TYPE::SqlValue key;
-            for (int i = 0; i < table.attributes.size(); i++)
-            {
-                if (table.attributes[i].name == attribute.name)
-                {
-                    key = record.values[i];
-                    break;
-                }
-            }
+        MINI_TYPE::SqlValue key;
+        if (iter.Visit([&](const RecordView & view) { key = view.Value(int(column)); }))
             im->InsertKey(index_name, key, iter.CurrentIndex());
-            
-        }
         if (not iter.Next())
             break;
     }
@@ -119,48 +451,138 @@ bool RecordManager::DropIndex(MINI_TYPE::TableInfo & table, const MINI_TYPE::Att
 }
 bool RecordManager::InsertRecord(MINI_TYPE::TableInfo & table, const MINI_TYPE::Record & record)
 {
-    int past_the_end_block_id = bm->PastTheEndBlockID(MINI_TYPE::TableFileName(table.name));
-    int start_record_index;
-    int record_length = table.record_length + 1;
-    int records_per_block = MINI_TYPE::BlockSize / record_length;
-    if (past_the_end_block_id == 0)
-        start_record_index = 0;
+    RecordIterator * cursor = nullptr;
+    int record_index = table.layout == MINI_TYPE::SlottedLayout
+                           ? InsertSlotted(table, PageSpace(table), record, cursor)
+                           : InsertFixed(table, FreeSpace(table), record, cursor);
+    cursor->Release();
+    for (std::size_t i = 0; i < table.attributes.size(); i++)
+    {
+        auto index = table.indices.find(table.attributes[i].name);
+        if (index != table.indices.end())
+            im->InsertKey(index->second, record.values[i], record_index);
+    }
+    table.record_count++;
+    return true;
+}
+
+bool RecordManager::InsertRecords(MINI_TYPE::TableInfo & table, const std::vector<MINI_TYPE::Record> & records)
+{
+    if (records.empty())
+        return true;
+    if (records.size() == 1)
+        return InsertRecord(table, records.front());
+    std::vector<int> record_indices(records.size());
+    RecordIterator * cursor = nullptr;
+    // both maps hand out the lowest free place, so each page is fetched
+    // once and filled in one go
+    if (table.layout == MINI_TYPE::SlottedLayout)
+    {
+        PageSpaceMap & pages = PageSpace(table);
+        for (std::size_t r = 0; r < records.size(); r++)
+            record_indices[r] = InsertSlotted(table, pages, records[r], cursor);
+    }
     else
-        start_record_index = records_per_block * (past_the_end_block_id - 1);
-    RecordIterator iter(table, start_record_index, bm);
-    while (true)
     {
-        MINI_TYPE::Record temp;
-        if (not iter.Read(temp))
-        {
-            iter.Write(record);
-            for (int i = 0; i < record.values.size(); i++)
-            {
-                if (table.indices.find(table.attributes[i].name) != table.indices.end())
-                    im->InsertKey(table.indices.at(table.attributes[i].name), record.values[i], iter.CurrentIndex());
-            }
-            break;
-        }
-        iter.Next(true);
+        FreeSpaceMap & free_slots = FreeSpace(table);
+        for (std::size_t r = 0; r < records.size(); r++)
+            record_indices[r] = InsertFixed(table, free_slots, records[r], cursor);
     }
-    
-    table.record_count ++;
+    cursor->Release();
+    IndexBatch(table, records, record_indices);
+    table.record_count += int(records.size());
     return true;
 }
 
+RecordManager::RecordIterator & RecordManager::InsertCursor(const MINI_TYPE::TableInfo & table, int record_index)
+{
+    auto cursor = insert_cursors.find(table.name);
+    if (cursor == insert_cursors.end())
+        return insert_cursors.emplace(table.name, RecordIterator(table, record_index, bm, RecordIterator::Append))
+            .first->second;
+    cursor->second.Seek(table, record_index);
+    return cursor->second;
+}
+
+int RecordManager::InsertFixed(const MINI_TYPE::TableInfo & table, FreeSpaceMap & free_slots,
+                               const MINI_TYPE::Record & record, RecordIterator *& cursor)
+{
+    while (true)
+    {
+        int slot = free_slots.Take();
+        if (not cursor)
+            cursor = &InsertCursor(table, slot);
+        else
+            cursor->Seek(table, slot);
+        // a slot the map calls free is checked anyway and skipped if taken
+        if (cursor->TryWrite(record))
+            return slot;
+    }
+}
+
+int RecordManager::InsertSlotted(const MINI_TYPE::TableInfo & table, PageSpaceMap & pages,
+                                 const MINI_TYPE::Record & record, RecordIterator *& cursor)
+{
+    int needed = RecordIterator::SlottedLength(record) + SlotEntrySize;
+    if (needed > MINI_TYPE::BlockSize - SlottedHeader)
+    {
+        std::cerr << "Record does not fit in a block!\n";
+        std::exit(0);
+    }
+    int records_per_block = RecordsPerBlock(table);
+    while (true)
+    {
+        int block_id = pages.Find(needed);
+        if (not cursor)
+            cursor = &InsertCursor(table, block_id * records_per_block);
+        else
+            cursor->Seek(table, block_id * records_per_block);
+        // a page the map overrates gets its real free space and the next one is tried
+        bool inserted = cursor->Insert(record);
+        pages.Set(block_id, cursor->FreeBytes());
+        if (inserted)
+            return cursor->CurrentIndex();
+    }
+}
+
+void RecordManager::IndexBatch(const MINI_TYPE::TableInfo & table, const std::vector<MINI_TYPE::Record> & records,
+                               const std::vector<int> & record_indices)
+{
+    // each tree gets its keys in ascending order
+    for (std::size_t i = 0; i < table.attributes.size(); i++)
+    {
+        auto index = table.indices.find(table.attributes[i].name);
+        if (index == table.indices.end())
+            continue;
+        std::vector<std::pair<MINI_TYPE::SqlValue, int>> keys;
+        for (std::size_t r = 0; r < records.size(); r++)
+            keys.emplace_back(records[r].values[i], record_indices[r]);
+        std::sort(keys.begin(), keys.end(), [](const std::pair<MINI_TYPE::SqlValue, int> & a,
+                                               const std::pair<MINI_TYPE::SqlValue, int> & b)
+                                            { return a.first < b.first; });
+        for (auto & key : keys)
+            im->InsertKey(index->second, key.first, key.second);
+    }
+}
+
 MINI_TYPE::Table RecordManager::SelectRecord(const MINI_TYPE::TableInfo & table, \
        const std::vector<MINI_TYPE::Condition> & conditions)
 {
     MINI_TYPE::Table result(table);
-    RecordIterator iter(table, 0, bm);
+    std::vector<BoundCondition> bound = BoundCondition::Bind(table, conditions);
+    RecordIterator iter(table, 0, bm, RecordIterator::Scan);
+    iter.Filter(bound);
+    // rows are tested in the page and copied out only if they qualify
+    auto qualify = [&](const RecordView & view)
+    {
+        if (not view.Test(bound))
+            return;
+        result.records.emplace_back();
+        view.Materialize(result.records.back());
+    };
     while (true)
     {
-        MINI_TYPE::Record temp;
-        if (iter.Read(temp))
-        {
-            if (MINI_TYPE::Test(conditions, table, temp))
-                result.records.push_back(temp);   
-        }
+        iter.Visit(qualify);
         if (not iter.Next())
                 break;
     }
@@ -198,38 +620,61 @@ MINI_TYPE::Table RecordManager::SelectRecord(const MINI_TYPE::TableInfo & table,
         finish = im->End(index);
     else
         finish = im->Find(index, cond_using_index.value);
+    // every condition is tested in the page, the indexed one included
+    std::vector<BoundCondition> bound = BoundCondition::Bind(table, conditions);
+    auto qualify = [&](const RecordView & view)
+    {
+        if (not view.Test(bound))
+            return;
+        result.records.emplace_back();
+        view.Materialize(result.records.back());
+    };
     IndexManager::iterator iter;
     for (iter = start; iter != finish; iter++)
     {
-        auto record_fetcher = RecordIterator(table, (*iter).second, bm);
-        MINI_TYPE::Record temp;
-        if (record_fetcher.Read(temp) and MINI_TYPE::Test(cond_using_index, table, temp))
-            result.records.push_back(temp);
+        RecordIterator record_fetcher(table, (*iter).second, bm);
+        record_fetcher.Visit(qualify);
     }
     // fetch last and test
 
     if (iter != im->End(index))
     {
-        auto record_fetcher = RecordIterator(table, (*iter).second, bm);
-        MINI_TYPE::Record temp;
-        if (record_fetcher.Read(temp) and MINI_TYPE::Test(cond_using_index, table, temp))
-            result.records.push_back(temp);
+        RecordIterator record_fetcher(table, (*iter).second, bm);
+        record_fetcher.Visit(qualify);
     }
     
 
-    return result.Select(conditions);
+    return result;
     
 }
 
 bool RecordManager::DeleteRecord(MINI_TYPE::TableInfo & table, const vector<MINI_TYPE::Condition> & conditions)
 {
-    auto iter = RecordIterator(table, 0, bm);
+    bool slotted = table.layout == MINI_TYPE::SlottedLayout;
+    FreeSpaceMap * free_slots = slotted ? nullptr : &FreeSpace(table);
+    PageSpaceMap * pages = slotted ? &PageSpace(table) : nullptr;
+    int records_per_block = RecordsPerBlock(table);
+    std::vector<BoundCondition> bound = BoundCondition::Bind(table, conditions);
+    RecordIterator iter(table, 0, bm, RecordIterator::Scan);
+    iter.Filter(bound);
     while (true)
     {
+        // only a matching row is copied out, for its index keys
         MINI_TYPE::Record temp;
-        if (iter.Read(temp) and MINI_TYPE::Test(conditions, table, temp))
+        bool matched = false;
+        iter.Visit([&](const RecordView & view)
+                   {
+                       matched = view.Test(bound);
+                       if (matched)
+                           view.Materialize(temp);
+                   });
+        if (matched)
         {
             iter.Delete();
+            if (slotted)
+                pages->Set(iter.CurrentIndex() / records_per_block, iter.FreeBytes());
+            else
+                free_slots->Release(iter.CurrentIndex());
             for (int i = 0; i < temp.values.size(); i++)
             {
                 if (table.indices.find(table.attributes[i].name) != table.indices.end())
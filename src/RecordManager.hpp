@@ -2,42 +2,136 @@
 #define RecordManager_hpp
 
 #include <iostream>
+#include <map>
+#include <memory>
 
 #include "MiniType.h"
 #include "BufferManager.h"
 #include "IndexManager.hpp"
+#include "FreeSpaceMap.hpp"
+#include "RecordView.hpp"
+#include "ScanFilter.hpp"
 class RecordManager
 {
 public:
     RecordManager(BufferManager *bm, IndexManager *im) : bm(bm), im(im) {}
+    // saves the free-space maps
+    ~RecordManager();
     bool CreateTableFile(const MINI_TYPE::TableInfo & table);
     bool DeleteTableFile(const MINI_TYPE::TableInfo & table);
     bool BuildIndex(MINI_TYPE::TableInfo & table, const MINI_TYPE::Attribute & attribute);
     bool DropIndex(MINI_TYPE::TableInfo & table, const MINI_TYPE::Attribute & attribute);
+    // One row, as from a single insert statement: the free slot is usually
+    // in the block the insert cursor was last on, which it pins again
+    // through its frame hint, and nothing is allocated.
     bool InsertRecord(MINI_TYPE::TableInfo & table, const MINI_TYPE::Record & record);
+    // Insert a batch: the records go in through the insert cursor one after
+    // the other, filling the free places page by page, then every index
+    // receives the batch's keys sorted.
+    // The caller has checked uniqueness.
+    bool InsertRecords(MINI_TYPE::TableInfo & table, const std::vector<MINI_TYPE::Record> & records);
     MINI_TYPE::Table SelectRecord(const MINI_TYPE::TableInfo & table, \
             const std::vector<MINI_TYPE::Condition> & conditions = vector<MINI_TYPE::Condition>());
     MINI_TYPE::Table SelectRecord(const MINI_TYPE::TableInfo & table, \
                                   const std::vector<MINI_TYPE::Condition> & conditions, const std::string & attr_using_index);
     bool DeleteRecord(MINI_TYPE::TableInfo & table, const vector<MINI_TYPE::Condition> & conditions = vector<MINI_TYPE::Condition>());
+    // Record indexes are block_id * RecordsPerBlock + slot in both layouts.
+    // A slotted page has room in its directory for as many of the table's
+    // shortest records as fit.
+    static int RecordsPerBlock(const MINI_TYPE::TableInfo & table);
 // private:
+    // each index receives the batch's keys in ascending order
+    void IndexBatch(const MINI_TYPE::TableInfo & table, const std::vector<MINI_TYPE::Record> & records,
+                    const std::vector<int> & record_indices);
     BufferManager * bm;
     IndexManager * im;
+    // The free-space map of a table, loaded or rebuilt on first use. A map
+    // file is deleted once read and rewritten by the destructor, so after a
+    // crash the map is rebuilt rather than trusted.
+    FreeSpaceMap & FreeSpace(const MINI_TYPE::TableInfo & table);
+    std::map<std::string, std::unique_ptr<FreeSpaceMap>> free_space;
+    // The same for a slotted table, whose pages are tracked by free bytes.
+    PageSpaceMap & PageSpace(const MINI_TYPE::TableInfo & table);
+    std::map<std::string, std::unique_ptr<PageSpaceMap>> page_space;
     class RecordIterator
     {
     public:
+        enum Access
+        {
+            Lookup,     // a record known to exist
+            Scan,       // the table from record_index on, with Next()
+            Append      // an insert cursor, which may move to the block past the end
+        };
         RecordIterator() {}
-        RecordIterator(const MINI_TYPE::TableInfo & table, int record_index, BufferManager * bm);
-        ~RecordIterator();
+        // Scans of big tables go through a buffer ring so they do not flush
+        // the pool, and a scan of an empty table has no block at all: only
+        // an insert cursor makes the file grow. The iterator refers to
+        // table, which must outlive it or be replaced by a later Seek.
+        RecordIterator(const MINI_TYPE::TableInfo & table, int record_index, BufferManager * bm,
+                       Access access = Lookup);
+        // Move to another record of the table, keeping the pinned block if
+        // the record is in it.
+        void Seek(const MINI_TYPE::TableInfo & table, int record_index);
+        // Unpin the current block, keeping the position; the next Seek
+        // pins it again, through the frame it was in for an insert cursor.
+        void Release();
         bool Read(MINI_TYPE::Record & record);
+        // Call f with a view of the current record while holding the page
+        // latch shared; false, without calling f, if the slot is empty.
+        template <typename F> bool Visit(F f)
+        {
+            if (not block)
+                return false;
+            std::shared_lock<std::shared_timed_mutex> guard(block.Latch());
+            const char * record = Locate();
+            if (not record)
+                return false;
+            f(RecordView(*table, record, offsets.data()));
+            return true;
+        }
         void Write(const MINI_TYPE::Record & r) const;
+        // Write unless the slot is in use; false if it was. Fixed layout only.
+        bool TryWrite(const MINI_TYPE::Record & r) const;
+        // Slotted layout: store the record in the current page and move to
+        // it; false if the page has no room for it.
+        bool Insert(const MINI_TYPE::Record & r);
+        // Slotted layout: bytes between the slot directory and the records.
+        int FreeBytes() const;
+        // Slotted layout: size of r in a page, without its directory entry.
+        static int SlottedLength(const MINI_TYPE::Record & r);
+        // In a slotted page the records behind the deleted one slide up to
+        // close the gap.
         void Delete();
         bool Next(bool expand = false);
+        // Let a scan of a fixed-layout table skip the slots that are empty
+        // or fail one of the int/float conditions, tested a page at a time
+        // by ScanFilter; Next() then stops only at the others. The current
+        // record is not skipped, and Visit callers still test every
+        // condition on what they are given.
+        void Filter(const std::vector<BoundCondition> & conditions);
         int CurrentIndex() {return record_index;}
     private:
-        MINI_TYPE::TableInfo table;
+        BufferManager::PageGuard Fetch(int block_id);
+        void WriteLatched(const MINI_TYPE::Record & r) const;
+        // slot directory entry of the current record, nullptr past its end
+        char * SlotEntry(char * page) const;
+        // the current record's bytes, nullptr for an empty slot; offsets are
+        // set for them. The latch must be held.
+        const char * Locate();
+        // the selection mask of the current block
+        void SelectSlots();
+        const MINI_TYPE::TableInfo * table;
         BufferManager * bm;
-        Block * block;
+        std::unique_ptr<BufferRing> ring;
+        BufferManager::PageGuard block;
+        int file_id;
+        bool mapped;    // the table is memory-mapped rather than pooled
+        bool slotted;   // the table's pages have a slot directory
+        bool appending; // blocks past the end may be fetched, and are appended
+        int frame_hint = -1;    // the frame the block was last in, for appending
+        std::vector<int> offsets;   // column offsets for RecordView
+        std::vector<BoundCondition> filters;    // conditions Next() applies per page
+        std::vector<std::uint64_t> selected;    // slots of this block they pass
         int record_length;
         int record_index;
         int records_per_block;
@@ -45,6 +139,24 @@ public:
         int in_block_record_index;
         int past_the_end_block_id;
     };
+    // One iterator per table parked on the block the last insert went to,
+    // so consecutive inserts into it do not look it up again. The block is
+    // pinned only while a statement or batch is inserted: a pin per table
+    // kept between statements would leave the pool without a victim once
+    // there are more tables than frames. Between statements the cursor
+    // keeps the block id and the frame it was in, and pins it again there
+    // if the page has stayed, without a page table lookup or read-ahead.
+    std::map<std::string, RecordIterator> insert_cursors;
+    // The table's insert cursor, moved to record_index.
+    RecordIterator & InsertCursor(const MINI_TYPE::TableInfo & table, int record_index);
+    // Store one record, in a free slot of a fixed-layout table or in the
+    // first page of a slotted table with room for it, moving cursor (the
+    // insert cursor, or nullptr before it is looked up) there; the record's
+    // index.
+    int InsertFixed(const MINI_TYPE::TableInfo & table, FreeSpaceMap & free_slots, const MINI_TYPE::Record & record,
+                    RecordIterator *& cursor);
+    int InsertSlotted(const MINI_TYPE::TableInfo & table, PageSpaceMap & pages, const MINI_TYPE::Record & record,
+                      RecordIterator *& cursor);
 };
 
 
@@ -0,0 +1,237 @@
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include "RecordView.hpp"
+
+int RecordView::Int(int column) const
+{
+    int value;
+    std::memcpy(&value, record + offsets[column], sizeof(int));
+    return value;
+}
+
+float RecordView::Float(int column) const
+{
+    float value;
+    std::memcpy(&value, record + offsets[column], sizeof(float));
+    return value;
+}
+
+const char * RecordView::Char(int column, std::size_t & length) const
+{
+    const char * begin = record + offsets[column];
+    std::size_t size = table->attributes[column].type.char_size;
+    const char * end = static_cast<const char *>(std::memchr(begin, 0, size));
+    length = end ? std::size_t(end - begin) : size;
+    return begin;
+}
+
+MINI_TYPE::SqlValue RecordView::Value(int column) const
+{
+    const MINI_TYPE::SqlValueType & type = table->attributes[column].type;
+    switch (type.type)
+    {
+        case MINI_TYPE::MiniInt: return MINI_TYPE::SqlValue(type, Int(column));
+        case MINI_TYPE::MiniFloat: return MINI_TYPE::SqlValue(type, Float(column));
+        case MINI_TYPE::MiniChar:
+        {
+            std::size_t length;
+            const char * chars = Char(column, length);
+            return MINI_TYPE::SqlValue(type, std::string(chars, length));
+        }
+    }
+    std::cerr << "Unknown Type!\n";
+    std::exit(0);
+}
+
+// The operators spelled the way SqlValue defines them from < and <=, so
+// that floats compare alike (a NaN field is "greater" than anything). Op is
+// a template argument: each instance folds to a single comparison.
+template <MINI_TYPE::Operator Op, typename T>
+static bool Compare(const T & field, const T & value)
+{
+    using MINI_TYPE::Operator;
+    switch (Op)
+    {
+        case Operator::Equal: return field <= value and not (field < value);
+        case Operator::GreaterThan: return not (field <= value);
+        case Operator::GreaterEqual: return not (field < value);
+        case Operator::LessThan: return field < value;
+        case Operator::LessEqual: return field <= value;
+        case Operator::NotEqual: return not (field <= value and not (field < value));
+    }
+    return false;
+}
+
+// How a field of each type is read and ordered against the literal.
+template <MINI_TYPE::TypeId Type> struct Field;
+
+template <> struct Field<MINI_TYPE::MiniInt>
+{
+    template <MINI_TYPE::Operator Op>
+    static bool Test(const char * field, const BoundCondition & condition)
+    {
+        int value;
+        std::memcpy(&value, field, sizeof(int));
+        return Compare<Op>(value, condition.i);
+    }
+};
+
+template <> struct Field<MINI_TYPE::MiniFloat>
+{
+    template <MINI_TYPE::Operator Op>
+    static bool Test(const char * field, const BoundCondition & condition)
+    {
+        float value;
+        std::memcpy(&value, field, sizeof(float));
+        return Compare<Op>(value, condition.f);
+    }
+};
+
+template <> struct Field<MINI_TYPE::MiniChar>
+{
+    template <MINI_TYPE::Operator Op>
+    static bool Test(const char * field, const BoundCondition & condition)
+    {
+        // std::string's ordering: bytes as unsigned, then length
+        const char * end = static_cast<const char *>(std::memchr(field, 0, condition.char_size));
+        std::size_t length = end ? std::size_t(end - field) : condition.char_size;
+        const std::string & value = condition.str;
+        int order = std::memcmp(field, value.data(), std::min(length, value.size()));
+        if (order == 0)
+            order = length < value.size() ? -1 : length > value.size() ? 1 : 0;
+        return Compare<Op>(order, 0);
+    }
+};
+
+template <MINI_TYPE::TypeId Type, MINI_TYPE::Operator Op, bool FixedOffset>
+static bool Evaluate(const BoundCondition & condition, const char * record, const int * offsets)
+{
+    const char * field = record + (FixedOffset ? condition.offset : offsets[condition.column]);
+    return Field<Type>::template Test<Op>(field, condition);
+}
+
+template <MINI_TYPE::TypeId Type, bool FixedOffset>
+static BoundCondition::Kernel PickKernel(MINI_TYPE::Operator op)
+{
+    using MINI_TYPE::Operator;
+    switch (op)
+    {
+        case Operator::Equal: return &Evaluate<Type, Operator::Equal, FixedOffset>;
+        case Operator::NotEqual: return &Evaluate<Type, Operator::NotEqual, FixedOffset>;
+        case Operator::GreaterThan: return &Evaluate<Type, Operator::GreaterThan, FixedOffset>;
+        case Operator::LessThan: return &Evaluate<Type, Operator::LessThan, FixedOffset>;
+        case Operator::GreaterEqual: return &Evaluate<Type, Operator::GreaterEqual, FixedOffset>;
+        case Operator::LessEqual: return &Evaluate<Type, Operator::LessEqual, FixedOffset>;
+    }
+    std::cerr << "Unknown Operator!\n";
+    std::exit(0);
+}
+
+template <bool FixedOffset>
+static BoundCondition::Kernel PickKernel(MINI_TYPE::TypeId type, MINI_TYPE::Operator op)
+{
+    switch (type)
+    {
+        case MINI_TYPE::MiniInt: return PickKernel<MINI_TYPE::MiniInt, FixedOffset>(op);
+        case MINI_TYPE::MiniFloat: return PickKernel<MINI_TYPE::MiniFloat, FixedOffset>(op);
+        case MINI_TYPE::MiniChar: return PickKernel<MINI_TYPE::MiniChar, FixedOffset>(op);
+    }
+    std::cerr << "Unknown Type!\n";
+    std::exit(0);
+}
+
+std::vector<BoundCondition> BoundCondition::Bind(const MINI_TYPE::TableInfo & table,
+                                                 const std::vector<MINI_TYPE::Condition> & conditions)
+{
+    std::vector<int> fixed_offsets;
+    if (table.layout != MINI_TYPE::SlottedLayout)
+        RecordView::FixedOffsets(table, fixed_offsets);
+    else
+    {
+        // in a slotted record the fields up to the first char value stay put
+        int byte_offset = 0;
+        for (auto & attribute : table.attributes)
+        {
+            fixed_offsets.push_back(byte_offset);
+            if (attribute.type.type == MINI_TYPE::MiniChar)
+                break;
+            byte_offset += int(attribute.type.TypeSize());
+        }
+    }
+    std::vector<BoundCondition> bound;
+    for (auto & condition : conditions)
+    {
+        std::size_t column = 0;
+        while (column < table.attributes.size() and table.attributes[column].name != condition.attributeName)
+            column++;
+        if (column == table.attributes.size())
+        {
+            std::cerr << "Attribute " + condition.attributeName + " does not exists!\n";
+            std::exit(0);
+        }
+        BoundCondition b;
+        b.column = int(column);
+        b.offset = column < fixed_offsets.size() ? fixed_offsets[column] : -1;
+        b.type = table.attributes[column].type.type;
+        b.char_size = table.attributes[column].type.char_size;
+        b.op = condition.op;
+        b.i = condition.value.i;
+        b.f = condition.value.f;
+        b.str = condition.value.str;
+        b.kernel = b.offset >= 0 ? PickKernel<true>(b.type, b.op) : PickKernel<false>(b.type, b.op);
+        bound.push_back(std::move(b));
+    }
+    return bound;
+}
+
+bool RecordView::Test(const BoundCondition & condition) const
+{
+    return condition.kernel(condition, record, offsets);
+}
+
+bool RecordView::Test(const std::vector<BoundCondition> & conditions) const
+{
+    for (const auto & condition : conditions)
+        if (not Test(condition))
+            return false;
+    return true;
+}
+
+void RecordView::Materialize(MINI_TYPE::Record & result) const
+{
+    result.values.clear();
+    result.values.reserve(table->attributes.size());
+    for (std::size_t column = 0; column < table->attributes.size(); column++)
+        result.values.push_back(Value(int(column)));
+}
+
+void RecordView::FixedOffsets(const MINI_TYPE::TableInfo & table, std::vector<int> & offsets)
+{
+    offsets.clear();
+    int byte_offset = 1;
+    for (auto & attribute : table.attributes)
+    {
+        offsets.push_back(byte_offset);
+        byte_offset += int(attribute.type.TypeSize());
+    }
+}
+
+void RecordView::SlottedOffsets(const MINI_TYPE::TableInfo & table, const char * record, std::vector<int> & offsets)
+{
+    offsets.clear();
+    int byte_offset = 0;
+    for (auto & attribute : table.attributes)
+    {
+        offsets.push_back(byte_offset);
+        if (attribute.type.type != MINI_TYPE::MiniChar)
+        {
+            byte_offset += int(attribute.type.TypeSize());
+            continue;
+        }
+        const char * begin = record + byte_offset;
+        const char * end = static_cast<const char *>(std::memchr(begin, 0, attribute.type.char_size));
+        byte_offset += end ? int(end - begin) + 1 : int(attribute.type.char_size);
+    }
+}
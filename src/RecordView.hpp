@@ -0,0 +1,61 @@
+#ifndef RecordView_hpp
+#define RecordView_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "MiniType.h"
+
+// A condition resolved against a table once per query: the column is an
+// ordinal, its byte offset is known when the layout fixes it, and the
+// literal is kept in the column's type. Bind also picks the evaluator
+// compiled for the column's type, the operator and whether the offset is
+// known, so testing a row does not branch on any of them.
+struct BoundCondition
+{
+    typedef bool (*Kernel)(const BoundCondition & condition, const char * record, const int * offsets);
+    Kernel kernel;
+    int column;
+    int offset;     // from the start of a record; -1 where it varies per record
+    MINI_TYPE::TypeId type;
+    std::size_t char_size;
+    MINI_TYPE::Operator op;
+    int i;
+    float f;
+    std::string str;
+    static std::vector<BoundCondition> Bind(const MINI_TYPE::TableInfo & table,
+                                            const std::vector<MINI_TYPE::Condition> & conditions);
+};
+
+// A record read in place from a pinned page: the fields are typed reads at
+// column offsets worked out once per table (or once per record of a slotted
+// table), so a scan can test a row without building a Record first. A view
+// borrows the page, which only stays valid while the RecordIterator that
+// made it holds the page latch; Materialize() copies out what must outlive
+// that.
+class RecordView
+{
+public:
+    RecordView(const MINI_TYPE::TableInfo & table, const char * record, const int * offsets)
+        : table(&table), record(record), offsets(offsets) {}
+    int Int(int column) const;
+    float Float(int column) const;
+    // a char value is its bytes up to the first 0 or the full char(n)
+    const char * Char(int column, std::size_t & length) const;
+    MINI_TYPE::SqlValue Value(int column) const;
+    // the same verdicts as MINI_TYPE::Test on the materialized record
+    bool Test(const BoundCondition & condition) const;
+    bool Test(const std::vector<BoundCondition> & conditions) const;
+    void Materialize(MINI_TYPE::Record & result) const;
+    // Offsets of the columns of a fixed-layout record, past its flag byte.
+    static void FixedOffsets(const MINI_TYPE::TableInfo & table, std::vector<int> & offsets);
+    // Offsets of the columns of a slotted record, whose char values are
+    // stored at their own length.
+    static void SlottedOffsets(const MINI_TYPE::TableInfo & table, const char * record, std::vector<int> & offsets);
+private:
+    const MINI_TYPE::TableInfo * table;
+    const char * record;
+    const int * offsets;
+};
+
+#endif /* RecordView_hpp */
@@ -0,0 +1,333 @@
+#include "ReplacementPolicy.h"
+
+// FrameList
+void FrameList::PushBack(int frame)
+{
+    if (member[frame])
+        return;
+    member[frame] = true;
+    prev[frame] = tail;
+    next[frame] = -1;
+    if (tail >= 0)
+        next[tail] = frame;
+    else
+        head = frame;
+    tail = frame;
+    size++;
+}
+
+void FrameList::PushFront(int frame)
+{
+    if (member[frame])
+        return;
+    member[frame] = true;
+    prev[frame] = -1;
+    next[frame] = head;
+    if (head >= 0)
+        prev[head] = frame;
+    else
+        tail = frame;
+    head = frame;
+    size++;
+}
+
+void FrameList::Remove(int frame)
+{
+    if (not member[frame])
+        return;
+    member[frame] = false;
+    if (prev[frame] >= 0)
+        next[prev[frame]] = next[frame];
+    else
+        head = next[frame];
+    if (next[frame] >= 0)
+        prev[next[frame]] = prev[frame];
+    else
+        tail = prev[frame];
+    size--;
+}
+
+int FrameList::PopFront()
+{
+    int frame = head;
+    if (frame >= 0)
+        Remove(frame);
+    return frame;
+}
+
+// ReplacementPolicy
+ReplacementPolicy * ReplacementPolicy::Create(Kind kind, int frames)
+{
+    switch (kind)
+    {
+        case Clock: return new ClockPolicy(frames);
+        case TwoQueue: return new TwoQueuePolicy(frames);
+        case LRU:
+        default: return new LRUPolicy(frames);
+    }
+}
+
+bool ReplacementPolicy::ParseKind(const std::string & name, Kind & kind)
+{
+    if (name == "lru")
+        kind = LRU;
+    else if (name == "clock")
+        kind = Clock;
+    else if (name == "2q")
+        kind = TwoQueue;
+    else
+        return false;
+    return true;
+}
+
+// LRUPolicy
+void LRUPolicy::Admit(int frame, std::uint64_t)
+{
+    resident[frame] = true;
+    lru.Remove(frame);
+    lru.PushBack(frame);
+}
+
+void LRUPolicy::Touch(int frame)
+{
+    if (lru.Contains(frame))
+    {
+        lru.Remove(frame);
+        lru.PushBack(frame);
+    }
+}
+
+void LRUPolicy::SetEvictable(int frame, bool evictable)
+{
+    if (not resident[frame])
+        return;
+    if (evictable)
+        lru.PushBack(frame);
+    else
+        lru.Remove(frame);
+}
+
+void LRUPolicy::Forget(int frame)
+{
+    resident[frame] = false;
+    lru.Remove(frame);
+}
+
+int LRUPolicy::Victim()
+{
+    int frame = lru.PopFront();
+    if (frame >= 0)
+        resident[frame] = false;
+    return frame;
+}
+
+void LRUPolicy::Restore(int frame)
+{
+    resident[frame] = true;
+}
+
+void LRUPolicy::Ranking(std::vector<int> & frames) const
+{
+    for (int frame = lru.Back(); frame >= 0; frame = lru.Prev(frame))
+        frames.push_back(frame);
+}
+
+// ClockPolicy
+void ClockPolicy::Admit(int frame, std::uint64_t)
+{
+    resident[frame] = true;
+    referenced[frame] = true;
+    evictable[frame] = true;
+}
+
+void ClockPolicy::Touch(int frame)
+{
+    referenced[frame] = true;
+}
+
+void ClockPolicy::SetEvictable(int frame, bool evictable)
+{
+    this->evictable[frame] = evictable;
+}
+
+void ClockPolicy::Forget(int frame)
+{
+    resident[frame] = referenced[frame] = false;
+}
+
+int ClockPolicy::Victim()
+{
+    int frames = int(resident.size());
+    // two sweeps: the first may only clear reference bits
+    for (int step = 0; step < 2 * frames; step++)
+    {
+        int frame = hand;
+        hand = (hand + 1) % frames;
+        if (not resident[frame] or not evictable[frame])
+            continue;
+        if (referenced[frame])
+            referenced[frame] = false;
+        else
+        {
+            resident[frame] = false;
+            return frame;
+        }
+    }
+    return -1;
+}
+
+void ClockPolicy::Restore(int frame)
+{
+    resident[frame] = true;
+}
+
+void ClockPolicy::Ranking(std::vector<int> & frames) const
+{
+    // referenced frames survive the next sweep; within each group the hand
+    // reaches the frames it has just passed last
+    int count = int(resident.size());
+    for (int pass = 0; pass < 2; pass++)
+        for (int step = 1; step <= count; step++)
+        {
+            int frame = ((hand - step) % count + count) % count;
+            if (resident[frame] and evictable[frame] and referenced[frame] == (pass == 0))
+                frames.push_back(frame);
+        }
+}
+
+// TwoQueuePolicy
+TwoQueuePolicy::TwoQueuePolicy(int frames)
+    : a1in(frames), am(frames), evictable(frames, false), queue(frames, None), victim_of(frames, None), keys(frames, 0)
+{
+    // tuning suggested by the 2Q paper: Kin = 25%, Kout = 50% of the pool
+    kin = frames / 4 > 0 ? frames / 4 : 1;
+    kout = std::size_t(frames / 2 > 0 ? frames / 2 : 1);
+}
+
+void TwoQueuePolicy::Remember(std::uint64_t key)
+{
+    a1out.push_back(key);
+    a1out_count[key]++;
+    if (a1out.size() > kout)
+    {
+        auto iter = a1out_count.find(a1out.front());
+        if (--iter->second == 0)
+            a1out_count.erase(iter);
+        a1out.pop_front();
+    }
+}
+
+void TwoQueuePolicy::Admit(int frame, std::uint64_t key)
+{
+    Forget(frame);
+    keys[frame] = key;
+    evictable[frame] = true;
+    if (a1out_count.count(key))
+        queue[frame] = Main;
+    else
+    {
+        queue[frame] = In;
+        a1in_count++;
+    }
+    ListOf(frame).PushBack(frame);
+}
+
+void TwoQueuePolicy::Touch(int frame)
+{
+    // hits in A1in are deliberately ignored: correlated references
+    // right after the first one do not make a page hot
+    if (queue[frame] == Main and am.Contains(frame))
+    {
+        am.Remove(frame);
+        am.PushBack(frame);
+    }
+}
+
+void TwoQueuePolicy::SetEvictable(int frame, bool evictable)
+{
+    // a frame keeps its place while set aside: A1in stays in admission order
+    if (queue[frame] == None)
+        return;
+    this->evictable[frame] = evictable;
+    if (not evictable or ListOf(frame).Contains(frame))
+        return;
+    // taken off by Victim() meanwhile: it was the oldest of A1in, and has
+    // just been used as far as Am is concerned
+    if (queue[frame] == In)
+        a1in.PushFront(frame);
+    else
+        am.PushBack(frame);
+}
+
+void TwoQueuePolicy::Forget(int frame)
+{
+    victim_of[frame] = None;
+    evictable[frame] = false;
+    if (queue[frame] == None)
+        return;
+    ListOf(frame).Remove(frame);
+    if (queue[frame] == In)
+        a1in_count--;
+    queue[frame] = None;
+}
+
+int TwoQueuePolicy::FirstEvictable(FrameList & list)
+{
+    // a head set aside leaves the list until it is evictable again, so
+    // each is passed over at most once
+    while (not list.Empty() and not evictable[list.Front()])
+        list.PopFront();
+    return list.Front();
+}
+
+int TwoQueuePolicy::Victim()
+{
+    int in = FirstEvictable(a1in);
+    int main = FirstEvictable(am);
+    int frame = (a1in_count > kin and in >= 0) or main < 0 ? in : main;
+    if (frame < 0)
+        return -1;
+    ListOf(frame).Remove(frame);
+    evictable[frame] = false;
+    if (queue[frame] == In)
+    {
+        a1in_count--;
+        Remember(keys[frame]);
+    }
+    victim_of[frame] = queue[frame];
+    queue[frame] = None;
+    return frame;
+}
+
+void TwoQueuePolicy::Restore(int frame)
+{
+    if (queue[frame] != None or victim_of[frame] == None)
+        return;
+    // back at the head of its queue, where Victim() found it, and in A1in
+    // without being promoted: the page is still resident, so the ghost
+    // Victim() left of it goes
+    queue[frame] = victim_of[frame];
+    victim_of[frame] = None;
+    ListOf(frame).PushFront(frame);
+    if (queue[frame] == In)
+    {
+        a1in_count++;
+        if (not a1out.empty() and a1out.back() == keys[frame])
+        {
+            auto iter = a1out_count.find(keys[frame]);
+            if (--iter->second == 0)
+                a1out_count.erase(iter);
+            a1out.pop_back();
+        }
+    }
+}
+
+void TwoQueuePolicy::Ranking(std::vector<int> & frames) const
+{
+    for (int frame = am.Back(); frame >= 0; frame = am.Prev(frame))
+        if (evictable[frame])
+            frames.push_back(frame);
+    for (int frame = a1in.Back(); frame >= 0; frame = a1in.Prev(frame))
+        if (evictable[frame])
+            frames.push_back(frame);
+}
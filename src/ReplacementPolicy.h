@@ -0,0 +1,149 @@
+#ifndef REPLACEMENTPOLICY_H_
+#define REPLACEMENTPOLICY_H_
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Doubly-linked list over frame indices. Every operation is O(1); a frame
+// can be in at most one list at a time.
+class FrameList
+{
+public:
+    explicit FrameList(int frames) : prev(frames, -1), next(frames, -1), member(frames, false) {}
+    void PushBack(int frame);
+    void PushFront(int frame);
+    void Remove(int frame);
+    int PopFront();
+    int Front() const { return head; }
+    int Back() const { return tail; }
+    int Prev(int frame) const { return prev[frame]; }
+    int Next(int frame) const { return next[frame]; }
+    bool Contains(int frame) const { return member[frame]; }
+    bool Empty() const { return head < 0; }
+    int Size() const { return size; }
+private:
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<bool> member;
+    int head = -1;
+    int tail = -1;
+    int size = 0;
+};
+
+// Decides which frame of the buffer pool to reuse on a miss. The buffer
+// manager reports every page load, but hits and pins only late, so that
+// they need no lock: a frame hit since the policy last looked is touched
+// when Victim() offers it, and a pinned one is set aside until it is
+// unpinned. Victim() picks a frame in constant (amortized, for CLOCK and
+// 2Q, and for the second chances) time and forgets it.
+class ReplacementPolicy
+{
+public:
+    enum Kind
+    {
+        LRU,
+        Clock,
+        TwoQueue
+    };
+    static ReplacementPolicy * Create(Kind kind, int frames);
+    // "lru", "clock" or "2q"; returns false for unknown names
+    static bool ParseKind(const std::string & name, Kind & kind);
+
+    virtual ~ReplacementPolicy() {}
+    // frame now holds the page identified by key, and may be offered
+    virtual void Admit(int frame, std::uint64_t key) = 0;
+    // frame was found in the page table since it was last looked at
+    virtual void Touch(int frame) = 0;
+    // frames set aside as not evictable are not offered until they are
+    // made evictable again
+    virtual void SetEvictable(int frame, bool evictable) = 0;
+    // frame no longer holds a page
+    virtual void Forget(int frame) = 0;
+    // an evictable frame to reuse, or -1 if there is none
+    virtual int Victim() = 0;
+    // frame, taken by Victim(), keeps its page after all: put it back where
+    // it was, not evictable, as if it had never been chosen. A frame the
+    // policy still has is left alone.
+    virtual void Restore(int frame) = 0;
+    // append the evictable frames, the ones to keep longest first
+    virtual void Ranking(std::vector<int> & frames) const = 0;
+};
+
+class LRUPolicy : public ReplacementPolicy
+{
+public:
+    explicit LRUPolicy(int frames) : lru(frames), resident(frames, false) {}
+    void Admit(int frame, std::uint64_t key) override;
+    void Touch(int frame) override;
+    void SetEvictable(int frame, bool evictable) override;
+    void Forget(int frame) override;
+    int Victim() override;
+    void Restore(int frame) override;
+    void Ranking(std::vector<int> & frames) const override;
+private:
+    // evictable resident frames, least recently used first
+    FrameList lru;
+    std::vector<bool> resident;
+};
+
+class ClockPolicy : public ReplacementPolicy
+{
+public:
+    explicit ClockPolicy(int frames)
+        : referenced(frames, false), evictable(frames, false), resident(frames, false) {}
+    void Admit(int frame, std::uint64_t key) override;
+    void Touch(int frame) override;
+    void SetEvictable(int frame, bool evictable) override;
+    void Forget(int frame) override;
+    int Victim() override;
+    void Restore(int frame) override;
+    void Ranking(std::vector<int> & frames) const override;
+private:
+    std::vector<bool> referenced;
+    std::vector<bool> evictable;
+    std::vector<bool> resident;
+    int hand = 0;
+};
+
+// Full 2Q (Johnson & Shasha): pages enter a FIFO (A1in) and are promoted to
+// the LRU queue (Am) only if they are referenced again after leaving it, as
+// remembered by the ghost queue A1out. A single scan therefore cannot flush
+// the pages in Am. A frame set aside as not evictable keeps its place in
+// its queue, so that A1in stays in admission order; Victim() takes one it
+// finds at the head of a queue off it until it is evictable again.
+class TwoQueuePolicy : public ReplacementPolicy
+{
+public:
+    explicit TwoQueuePolicy(int frames);
+    void Admit(int frame, std::uint64_t key) override;
+    void Touch(int frame) override;
+    void SetEvictable(int frame, bool evictable) override;
+    void Forget(int frame) override;
+    int Victim() override;
+    void Restore(int frame) override;
+    void Ranking(std::vector<int> & frames) const override;
+private:
+    enum Queue { None, In, Main };
+    void Remember(std::uint64_t key);
+    FrameList & ListOf(int frame) { return queue[frame] == In ? a1in : am; }
+    // the first evictable frame of list, or -1
+    int FirstEvictable(FrameList & list);
+    // resident frames of each queue; one set aside only until Victim()
+    // reaches it
+    FrameList a1in;
+    FrameList am;
+    std::vector<bool> evictable;
+    int a1in_count = 0;
+    int kin;
+    std::size_t kout;
+    std::vector<Queue> queue;
+    std::vector<Queue> victim_of;   // the queue Victim() last took the frame from
+    std::vector<std::uint64_t> keys;
+    std::deque<std::uint64_t> a1out;
+    std::unordered_map<std::uint64_t, int> a1out_count;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "ScanFilter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_FILTER_X86 1
+#endif
+
+using MINI_TYPE::Operator;
+
+// Keep the slots from first on whose bit is set in the lanes low bits of
+// passed; lanes divides 64 and first is a multiple of it.
+static inline void Keep(std::uint64_t * mask, int first, unsigned passed, int lanes)
+{
+    std::uint64_t failed = ~std::uint64_t(passed) & ((std::uint64_t(1) << lanes) - 1);
+    mask[first / 64] &= ~(failed << (first % 64));
+}
+
+// Slots from first on tested one at a time by the condition's own kernel;
+// this is the whole scalar path and the tail of the vector ones.
+static void ApplyRows(const BoundCondition & condition, const char * page, int stride, int first, int count,
+                      std::uint64_t * mask)
+{
+    for (int slot = first; slot < count; slot++)
+    {
+        if (not condition.kernel(condition, page + slot * stride, nullptr))
+            mask[slot / 64] &= ~(std::uint64_t(1) << (slot % 64));
+    }
+}
+
+struct ScalarKernels
+{
+    template <Operator Op>
+    static void Int(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+    {
+        ApplyRows(condition, page, stride, 0, count, mask);
+    }
+    template <Operator Op>
+    static void Float(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+    {
+        ApplyRows(condition, page, stride, 0, count, mask);
+    }
+};
+
+#ifdef SCAN_FILTER_X86
+
+// Results are inverted where the operator is the negation of a compare the
+// instruction set has, following SqlValue: >= is not <, != is not ==.
+// Float compares pick ordered or unordered predicates to the same effect,
+// so a NaN field passes >, >= and != and fails the rest.
+
+struct Sse2Kernels
+{
+    template <Operator Op>
+    __attribute__((target("sse2")))
+    static void Int(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+    {
+        const char * field = page + condition.offset;
+        __m128i literal = _mm_set1_epi32(condition.i);
+        int slot = 0;
+        for (; slot + 4 <= count; slot += 4)
+        {
+            int values[4];
+            for (int lane = 0; lane < 4; lane++)
+                std::memcpy(&values[lane], field + (slot + lane) * stride, sizeof(int));
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values));
+            __m128i result;
+            if (Op == Operator::Equal or Op == Operator::NotEqual)
+                result = _mm_cmpeq_epi32(v, literal);
+            else if (Op == Operator::GreaterThan or Op == Operator::LessEqual)
+                result = _mm_cmpgt_epi32(v, literal);
+            else
+                result = _mm_cmplt_epi32(v, literal);
+            unsigned passed = unsigned(_mm_movemask_ps(_mm_castsi128_ps(result)));
+            if (Op == Operator::NotEqual or Op == Operator::LessEqual or Op == Operator::GreaterEqual)
+                passed ^= 0xf;
+            Keep(mask, slot, passed, 4);
+        }
+        ApplyRows(condition, page, stride, slot, count, mask);
+    }
+    template <Operator Op>
+    __attribute__((target("sse2")))
+    static void Float(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+    {
+        const char * field = page + condition.offset;
+        __m128 literal = _mm_set1_ps(condition.f);
+        int slot = 0;
+        for (; slot + 4 <= count; slot += 4)
+        {
+            float values[4];
+            for (int lane = 0; lane < 4; lane++)
+                std::memcpy(&values[lane], field + (slot + lane) * stride, sizeof(float));
+            __m128 v = _mm_loadu_ps(values);
+            __m128 result;
+            switch (Op)
+            {
+                case Operator::Equal: result = _mm_cmpeq_ps(v, literal); break;
+                case Operator::NotEqual: result = _mm_cmpneq_ps(v, literal); break;
+                case Operator::GreaterThan: result = _mm_cmpnle_ps(v, literal); break;
+                case Operator::GreaterEqual: result = _mm_cmpnlt_ps(v, literal); break;
+                case Operator::LessThan: result = _mm_cmplt_ps(v, literal); break;
+                case Operator::LessEqual: result = _mm_cmple_ps(v, literal); break;
+            }
+            Keep(mask, slot, unsigned(_mm_movemask_ps(result)), 4);
+        }
+        ApplyRows(condition, page, stride, slot, count, mask);
+    }
+};
+
+struct Avx2Kernels
+{
+    template <Operator Op>
+    __attribute__((target("avx2")))
+    static void Int(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+    {
+        const int * field = reinterpret_cast<const int *>(page + condition.offset);
+        __m256i literal = _mm256_set1_epi32(condition.i);
+        __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+        __m256i step = _mm256_set1_epi32(8 * stride);
+        int slot = 0;
+        for (; slot + 8 <= count; slot += 8, index = _mm256_add_epi32(index, step))
+        {
+            __m256i v = _mm256_i32gather_epi32(field, index, 1);
+            __m256i result;
+            if (Op == Operator::Equal or Op == Operator::NotEqual)
+                result = _mm256_cmpeq_epi32(v, literal);
+            else if (Op == Operator::GreaterThan or Op == Operator::LessEqual)
+                result = _mm256_cmpgt_epi32(v, literal);
+            else
+                result = _mm256_cmpgt_epi32(literal, v);
+            unsigned passed = unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(result)));
+            if (Op == Operator::NotEqual or Op == Operator::LessEqual or Op == Operator::GreaterEqual)
+                passed ^= 0xff;
+            Keep(mask, slot, passed, 8);
+        }
+        ApplyRows(condition, page, stride, slot, count, mask);
+    }
+    template <Operator Op>
+    __attribute__((target("avx2")))
+    static void Float(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+    {
+        const float * field = reinterpret_cast<const float *>(page + condition.offset);
+        __m256 literal = _mm256_set1_ps(condition.f);
+        __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+        __m256i step = _mm256_set1_epi32(8 * stride);
+        int slot = 0;
+        for (; slot + 8 <= count; slot += 8, index = _mm256_add_epi32(index, step))
+        {
+            __m256 v = _mm256_i32gather_ps(field, index, 1);
+            __m256 result;
+            switch (Op)
+            {
+                case Operator::Equal: result = _mm256_cmp_ps(v, literal, _CMP_EQ_OQ); break;
+                case Operator::NotEqual: result = _mm256_cmp_ps(v, literal, _CMP_NEQ_UQ); break;
+                case Operator::GreaterThan: result = _mm256_cmp_ps(v, literal, _CMP_NLE_UQ); break;
+                case Operator::GreaterEqual: result = _mm256_cmp_ps(v, literal, _CMP_NLT_UQ); break;
+                case Operator::LessThan: result = _mm256_cmp_ps(v, literal, _CMP_LT_OQ); break;
+                case Operator::LessEqual: result = _mm256_cmp_ps(v, literal, _CMP_LE_OQ); break;
+            }
+            Keep(mask, slot, unsigned(_mm256_movemask_ps(result)), 8);
+        }
+        ApplyRows(condition, page, stride, slot, count, mask);
+    }
+};
+
+#endif
+
+typedef void (*ApplyFunction)(const BoundCondition & condition, const char * page, int stride, int count,
+                              std::uint64_t * mask);
+
+template <typename Kernels>
+static void ApplyWith(const BoundCondition & condition, const char * page, int stride, int count, std::uint64_t * mask)
+{
+    bool is_int = condition.type == MINI_TYPE::MiniInt;
+    switch (condition.op)
+    {
+        case Operator::Equal:
+            return is_int ? Kernels::template Int<Operator::Equal>(condition, page, stride, count, mask)
+                          : Kernels::template Float<Operator::Equal>(condition, page, stride, count, mask);
+        case Operator::NotEqual:
+            return is_int ? Kernels::template Int<Operator::NotEqual>(condition, page, stride, count, mask)
+                          : Kernels::template Float<Operator::NotEqual>(condition, page, stride, count, mask);
+        case Operator::GreaterThan:
+            return is_int ? Kernels::template Int<Operator::GreaterThan>(condition, page, stride, count, mask)
+                          : Kernels::template Float<Operator::GreaterThan>(condition, page, stride, count, mask);
+        case Operator::LessThan:
+            return is_int ? Kernels::template Int<Operator::LessThan>(condition, page, stride, count, mask)
+                          : Kernels::template Float<Operator::LessThan>(condition, page, stride, count, mask);
+        case Operator::GreaterEqual:
+            return is_int ? Kernels::template Int<Operator::GreaterEqual>(condition, page, stride, count, mask)
+                          : Kernels::template Float<Operator::GreaterEqual>(condition, page, stride, count, mask);
+        case Operator::LessEqual:
+            return is_int ? Kernels::template Int<Operator::LessEqual>(condition, page, stride, count, mask)
+                          : Kernels::template Float<Operator::LessEqual>(condition, page, stride, count, mask);
+    }
+}
+
+struct KernelSet
+{
+    const char * name;
+    ApplyFunction apply;
+};
+
+static KernelSet PickKernels()
+{
+    KernelSet scalar = {"scalar", &ApplyWith<ScalarKernels>};
+#ifdef SCAN_FILTER_X86
+    KernelSet sse2 = {"sse2", &ApplyWith<Sse2Kernels>};
+    KernelSet avx2 = {"avx2", &ApplyWith<Avx2Kernels>};
+    __builtin_cpu_init();
+    bool has_sse2 = __builtin_cpu_supports("sse2");
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (const char * wanted = std::getenv("MINISQL_SIMD"))
+    {
+        if (std::strcmp(wanted, "scalar") == 0)
+            return scalar;
+        if (std::strcmp(wanted, "sse2") == 0 and has_sse2)
+            return sse2;
+        if (std::strcmp(wanted, "avx2") != 0 and std::strcmp(wanted, "sse2") != 0)
+            std::cerr << "Unknown SIMD kernels " << wanted << ", ignored.\n";
+    }
+    if (has_avx2)
+        return avx2;
+    if (has_sse2)
+        return sse2;
+#endif
+    return scalar;
+}
+
+static const KernelSet & Kernels()
+{
+    static const KernelSet kernels = PickKernels();
+    return kernels;
+}
+
+bool ScanFilter::Vectorizable(const BoundCondition & condition)
+{
+    return condition.offset >= 0 and (condition.type == MINI_TYPE::MiniInt or condition.type == MINI_TYPE::MiniFloat);
+}
+
+void ScanFilter::Occupied(const char * page, int stride, int count, std::uint64_t * mask)
+{
+    std::memset(mask, 0, MaskWords * sizeof(std::uint64_t));
+    for (int slot = 0; slot < count; slot++)
+    {
+        if (page[slot * stride] != MINI_TYPE::Empty)
+            mask[slot / 64] |= std::uint64_t(1) << (slot % 64);
+    }
+}
+
+void ScanFilter::Apply(const BoundCondition & condition, const char * page, int stride, int count,
+                       std::uint64_t * mask)
+{
+    Kernels().apply(condition, page, stride, count, mask);
+}
+
+const char * ScanFilter::KernelName()
+{
+    return Kernels().name;
+}
@@ -0,0 +1,33 @@
+#ifndef ScanFilter_hpp
+#define ScanFilter_hpp
+
+#include <cstdint>
+#include "MiniType.h"
+#include "RecordView.hpp"
+
+// Page-at-a-time filtering of a fixed-layout block. The int or float field
+// a condition tests sits at the same offset in every slot, so a kernel
+// gathers it from a run of slots at once, compares them with AVX2 or SSE2
+// where the CPU has them (a plain loop otherwise) and clears the bits of
+// the slots that fail in a selection mask, one bit per slot.
+//
+// The kernels are chosen once, at the first use; MINISQL_SIMD=scalar, sse2
+// or avx2 asks for a particular set, which is honoured if the CPU has it.
+class ScanFilter
+{
+public:
+    static const int MaskWords = MINI_TYPE::BlockSize / 64;     // enough for any stride
+    // the condition tests an int or float at a fixed offset
+    static bool Vectorizable(const BoundCondition & condition);
+    // Set the mask to the slots in use among the count slots of stride
+    // bytes at page.
+    static void Occupied(const char * page, int stride, int count, std::uint64_t * mask);
+    // Clear the mask bits of the slots failing condition, which must be
+    // vectorizable.
+    static void Apply(const BoundCondition & condition, const char * page, int stride, int count,
+                      std::uint64_t * mask);
+    // "avx2", "sse2" or "scalar"
+    static const char * KernelName();
+};
+
+#endif /* ScanFilter_hpp */
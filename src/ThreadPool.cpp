@@ -0,0 +1,47 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threads)
+{
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(latch);
+        stopping = true;
+        tasks.clear();
+    }
+    wakeup.notify_all();
+    for (auto & worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> guard(latch);
+        if (stopping)
+            return;
+        tasks.push_back(std::move(task));
+    }
+    wakeup.notify_one();
+}
+
+void ThreadPool::Work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(latch);
+            wakeup.wait(lock, [this] { return stopping or not tasks.empty(); });
+            if (stopping)
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running queued tasks in FIFO order. Tasks still
+// queued when the pool is destroyed are dropped, so it is only suitable for
+// work that may be skipped, such as prefetching.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+    void Submit(std::function<void()> task);
+private:
+    void Work();
+    std::mutex latch;
+    std::condition_variable wakeup;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};
+
+#endif
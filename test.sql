@@ -41,4 +41,12 @@ select * from testTableA;
 
 insert into testTableA values ("E", 20, 124);
 
-select * from testTableA where age = 20 and number = 124;
\ No newline at end of file
+select * from testTableA where age = 20 and number = 124;
+
+insert into testTableA values ("F, G", 30, 130), ('H (I)', 31, 131), ("J)", 32, 132);
+
+select * from testTableA where age > 29;
+
+select * from testTableA where name = "F, G";
+
+insert into testTableA values ("K", 33, 133) ("L", 34, 134);
\ No newline at end of file